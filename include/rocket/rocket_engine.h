@@ -26,25 +26,401 @@
 #pragma once
 
 #include <fcntl.h>
+#include <stdint.h>
 #include <rocket/rocket_types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Only the thread that created the engine submits requests to it.
+#define ROCKET_ENGINE_SINGLE_ISSUER (1U << 0)
+// Run completion work only when the executor waits for completions instead of
+// interrupting the thread. Implies ROCKET_ENGINE_SINGLE_ISSUER.
+#define ROCKET_ENGINE_DEFER_TASKRUN (1U << 1)
+// Don't interrupt the thread to run completion work as soon as it's ready.
+#define ROCKET_ENGINE_COOP_TASKRUN (1U << 2)
+// Fail engine creation if the kernel could drop completions when the
+// completion queue overflows.
+#define ROCKET_ENGINE_REQUIRE_NODROP (1U << 3)
+// Let a kernel thread poll the submission queue, so that submitting requests
+// needs no syscall while the thread is awake. Excludes
+// ROCKET_ENGINE_DEFER_TASKRUN.
+#define ROCKET_ENGINE_SQPOLL (1U << 4)
+// Try socket sends and receives with a non-blocking syscall first, and only
+// go through the ring when they would block. Other requests are submitted
+// right away, and the fiber only parks if the kernel didn't complete them
+// during submission. Trades batching of submissions for fewer fiber
+// switches, which pays off when most requests complete immediately.
+#define ROCKET_ENGINE_FAST_PATH (1U << 5)
+// With napi_busy_poll_us, keep the network device in busy polling mode
+// instead of re-enabling its interrupts between polls.
+#define ROCKET_ENGINE_NAPI_PREFER_BUSY_POLL (1U << 6)
+// Poll storage devices for completions instead of waiting for interrupts.
+// Only reads and writes of files opened with O_DIRECT, on devices with poll
+// queues, are supported, and they must be aligned to
+// ROCKET_DIRECT_IO_ALIGNMENT. Other requests and I/O timeouts aren't, so
+// storage is best served by an engine of its own.
+#define ROCKET_ENGINE_IOPOLL (1U << 7)
+
+// Alignment of the buffers, file offsets and lengths of direct I/O requests,
+// which covers the logical block size of common devices.
+#define ROCKET_DIRECT_IO_ALIGNMENT 4096
+
+// Mechanism an engine performs requests with.
+typedef enum {
+  // Requests are submitted to the kernel through io_uring.
+  ROCKET_ENGINE_IO_URING = 0,
+  // Socket requests are performed right away with non-blocking syscalls, and
+  // fibers only wait for readiness through epoll when they would block.
+  // accept_await and connect_await set O_NONBLOCK on their socket and leave
+  // it set. File requests run on a pool of worker threads. Requests specific
+  // to io_uring fail with -EOPNOTSUPP.
+  ROCKET_ENGINE_EPOLL = 1,
+} rocket_engine_backend_t;
+
+typedef struct {
+  rocket_engine_backend_t backend;
+  // Number of submission queue entries.
+  unsigned queue_depth;
+  // Number of completion queue entries. 0 means twice the queue depth.
+  unsigned cq_entries;
+  // Bitwise OR of ROCKET_ENGINE_* flags. Flags not supported by the running
+  // kernel are dropped at engine creation.
+  unsigned flags;
+  // See rocket_engine_set_submit_batch_size.
+  size_t submit_batch_size;
+  // Milliseconds the submission queue polling thread spins without work
+  // before going to sleep. 0 means the kernel default.
+  unsigned sq_thread_idle_ms;
+  // CPU the submission queue polling thread is pinned to. -1 means no pinning.
+  int sq_thread_cpu;
+  // Engine whose kernel workers, including the submission queue polling
+  // thread, are shared instead of creating new ones. NULL means none. It must
+  // outlive this engine.
+  rocket_engine_t* attach_engine;
+  // Maximum number of threads running calls passed to rocket_offload_await,
+  // started on first use. 0 means the default of 4.
+  unsigned offload_threads;
+  // Microseconds the executor spins on the completion queue at most before
+  // sleeping in the kernel when it runs out of runnable fibers. The window
+  // adapts to how soon completions recently arrived, down to no spinning when
+  // they are too sparse. Trades CPU time for wakeup latency. 0 disables
+  // busy-polling. Only supported by the io_uring engine.
+  unsigned busy_poll_us;
+  // Microseconds the kernel busy-polls the receive queues of the network
+  // devices of the sockets the engine waits on (NAPI), instead of waiting for
+  // interrupts, while the executor waits for completions. Sockets join as
+  // soon as a request waits for them, including accepted ones. 0 disables
+  // it, and so does a kernel without support for it. Only supported by the
+  // io_uring engine.
+  unsigned napi_busy_poll_us;
+} rocket_engine_config_t;
+
+// Initialize config with the default settings for the given queue depth.
+void rocket_engine_config_init(rocket_engine_config_t* config,
+                               size_t queue_depth);
+
 rocket_engine_t* rocket_engine_create(size_t queue_depth);
+rocket_engine_t* rocket_engine_create_ex(const rocket_engine_config_t* config);
 void rocket_engine_destroy(rocket_engine_t* engine);
+// Retrieve the configuration in effect, which only has the flags supported by
+// the running kernel.
+void rocket_engine_get_config(const rocket_engine_t* engine,
+                              rocket_engine_config_t* config);
+
+// Counters of how an engine served requests since its creation.
+typedef struct {
+  // Requests ROCKET_ENGINE_FAST_PATH completed with a non-blocking syscall
+  // instead of a submission queue entry.
+  uint64_t fast_path_syscalls;
+  // Times busy-polling found completions before the executor went to sleep
+  // in the kernel. See busy_poll_us.
+  uint64_t busy_poll_hits;
+  // Current busy-poll window in nanoseconds.
+  uint64_t busy_poll_window_ns;
+  // Times a fiber waited for the executor to make room in a full submission
+  // queue.
+  uint64_t sq_waits;
+} rocket_engine_stats_t;
+
+void rocket_engine_get_stats(const rocket_engine_t* engine,
+                             rocket_engine_stats_t* stats);
+// Requests issued by fibers are queued and submitted together once the
+// executor runs out of runnable fibers. Setting a non-zero batch size also
+// submits them as soon as that many requests are queued.
+void rocket_engine_set_submit_batch_size(rocket_engine_t* engine,
+                                         size_t batch_size);
+
+// Let the kernel pick a free slot in the fixed file table.
+#define ROCKET_FILE_INDEX_ALLOC (~0U)
+
+// Register a fixed file table of nr_files empty slots. Requests on fixed files
+// skip the per-request file reference counting of regular file descriptors.
+// The *_direct_await functions take slot indices instead of file descriptors.
+// Returns 0 on success, a negative errno on failure.
+int rocket_engine_register_files(rocket_engine_t* engine, unsigned nr_files);
+// Install a regular file descriptor into a slot of the fixed file table, or
+// empty the slot if fd is -1. The descriptor can be closed afterwards.
+// Returns 0 on success, a negative errno on failure.
+int rocket_engine_update_file(rocket_engine_t* engine, unsigned file_index,
+                              int fd);
+int rocket_engine_unregister_files(rocket_engine_t* engine);
+
+// Allocate nr_buffers buffers of buffer_size bytes each and register them with
+// the kernel, which then skips mapping their pages on every request. Buffers
+// are handed out with rocket_engine_alloc_buffer and used with the
+// *_fixed_await functions. Returns 0 on success, a negative errno on failure.
+int rocket_engine_register_buffers(rocket_engine_t* engine,
+                                   unsigned nr_buffers, size_t buffer_size);
+// Unregister and free the buffers. None of them may be in use.
+int rocket_engine_unregister_buffers(rocket_engine_t* engine);
+// Hand out a registered buffer and store its index in buf_index.
+// Returns NULL if all buffers are in use.
+void* rocket_engine_alloc_buffer(rocket_engine_t* engine, int* buf_index);
+void rocket_engine_free_buffer(rocket_engine_t* engine, int buf_index);
+
+// Allocate a buffer of at least size bytes for direct I/O, aligned to
+// ROCKET_DIRECT_IO_ALIGNMENT with its size rounded up to a multiple of it.
+// Returns NULL on failure.
+void* rocket_direct_io_alloc(size_t size);
+void rocket_direct_io_free(void* buf);
 
 int openat_await(int dirfd, const char* pathname, int oflag, ...);
 ssize_t readat_await(int fd, void* buf, size_t nbyts, off_t offset);
 ssize_t writeat_await(int fd, const void* buf, size_t nbyts, off_t offset);
 int close_await(int fd);
+ssize_t readv_await(int fd, const struct iovec* iov, int iovcnt,
+                    off_t offset);
+ssize_t writev_await(int fd, const struct iovec* iov, int iovcnt,
+                     off_t offset);
+// buf must lie within the registered buffer buf_index.
+ssize_t readat_fixed_await(int fd, void* buf, size_t nbytes, off_t offset,
+                           int buf_index);
+ssize_t writeat_fixed_await(int fd, const void* buf, size_t nbytes,
+                            off_t offset, int buf_index);
+// Open a file straight into a fixed file slot, or into a free one with
+// ROCKET_FILE_INDEX_ALLOC. Returns the slot index.
+int openat_direct_await(int dirfd, const char* pathname, int oflag,
+                        mode_t mode, unsigned file_index);
+ssize_t readat_direct_await(int file_index, void* buf, size_t nbytes,
+                            off_t offset);
+ssize_t writeat_direct_await(int file_index, const void* buf, size_t nbytes,
+                             off_t offset);
+int close_direct_await(unsigned file_index);
+
+// Only flush the data of the file and the metadata needed to read it back,
+// like fdatasync.
+#define ROCKET_FSYNC_DATASYNC (1U << 0)
+
+int fsync_await(int fd);
+int fdatasync_await(int fd);
+// flags are the SYNC_FILE_RANGE_* flags of sync_file_range.
+int sync_file_range_await(int fd, off_t offset, off_t nbytes,
+                          unsigned flags);
+
+struct statx;
+
+// File and directory metadata requests. Arguments are those of the syscalls
+// of the same names, with renameat taking the flags of renameat2.
+int statx_await(int dirfd, const char* pathname, int flags, unsigned mask,
+                struct statx* statxbuf);
+int fallocate_await(int fd, int mode, off_t offset, off_t len);
+int ftruncate_await(int fd, off_t length);
+int unlinkat_await(int dirfd, const char* pathname, int flags);
+int renameat_await(int olddirfd, const char* oldpath, int newdirfd,
+                   const char* newpath, unsigned flags);
+int mkdirat_await(int dirfd, const char* pathname, mode_t mode);
+
+// Access pattern hints, with the POSIX_FADV_* and MADV_* advice of
+// posix_fadvise and madvise.
+int fadvise_await(int fd, off_t offset, off_t len, int advice);
+int madvise_await(void* addr, size_t len, int advice);
+// Start reading len bytes of fd from offset into the page cache, like
+// POSIX_FADV_WILLNEED, without suspending the current fiber. The result of
+// the readahead is ignored, but the executor keeps running until it's done.
+// Returns 0 once the hint is queued, or a negative error number if none of it
+// could be, e.g. -EBUSY when the submission queue is full.
+int rocket_prefetch(int fd, off_t offset, off_t len);
+
+// Suspend the current fiber for duration_ns nanoseconds. Returns 0, or
+// -ECANCELED if the fiber is canceled.
+int rocket_sleep_await(uint64_t duration_ns);
+// Cancel all in-flight requests on fd, whose fibers resume with -ECANCELED.
+// Returns the number of canceled requests.
+int cancel_fd_await(int fd);
+int cancel_fd_direct_await(unsigned file_index);
+
+// Blocking call run on a worker thread. Returns the result to hand back to
+// the fiber.
+typedef long (*rocket_offload_func_t)(void* arg);
+// Run func(arg) on a worker thread of the engine, for blocking calls without
+// an asynchronous equivalent (e.g. getaddrinfo), and suspend the current fiber
+// until it returns, while other fibers keep running. Returns the result of
+// func, or a negative errno if it couldn't be started. Once started, the call
+// runs to completion even if the fiber is canceled. Engines created with
+// ROCKET_ENGINE_IOPOLL can't wait for the worker threads and return
+// -EOPNOTSUPP.
+long rocket_offload_await(rocket_offload_func_t func, void* arg);
 
 int accept_await(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
                  int flags);
+// Client side of connections. Like the other requests, these return a
+// negative errno on failure.
+int socket_await(int domain, int type, int protocol);
+int connect_await(int sockfd, const struct sockaddr* addr, socklen_t addrlen);
+int shutdown_await(int sockfd, int how);
+// These never wait, so they complete right away without suspending the fiber.
+int bind_await(int sockfd, const struct sockaddr* addr, socklen_t addrlen);
+int listen_await(int sockfd, int backlog);
 ssize_t send_await(int sockfd, const void *buf, size_t len, int flags);
 ssize_t recv_await(int sockfd, void *buf, size_t len, int flags);
+// Called from the executor thread once the kernel no longer references the
+// buffer of a zero-copy send.
+typedef void (*rocket_release_func_t)(void* context);
+// Send buf without copying it into the socket buffer. Returns once the send
+// completes, but buf must stay untouched until release is called with
+// release_context, which can happen before or after this returns. The I/O
+// timeout of the fiber applies, as for other requests.
+ssize_t send_zc_await(int sockfd, const void *buf, size_t len, int flags,
+                      rocket_release_func_t release, void* release_context);
+// Including ancillary data in msg_control.
+ssize_t sendmsg_await(int sockfd, const struct msghdr* msg, int flags);
+ssize_t recvmsg_await(int sockfd, struct msghdr* msg, int flags);
+// Accept a connection straight into a fixed file slot, or into a free one with
+// ROCKET_FILE_INDEX_ALLOC. Returns the slot index.
+int accept_direct_await(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
+                        int flags, unsigned file_index);
+// Keep accepting connections on sockfd with a single multishot request and
+// submit a task running func for each of them to the executor, with the
+// connection's file descriptor cast to a pointer as its context. Returns only
+// once accepting fails, with the error.
+int accept_multishot_await(int sockfd, rocket_task_func_t func, int flags);
+// Same as accept_multishot_await, but the connections are installed into free
+// fixed file slots and the tasks get the slot index instead.
+int accept_multishot_direct_await(int sockfd, rocket_task_func_t func,
+                                  int flags);
+ssize_t send_direct_await(int file_index, const void *buf, size_t len,
+                          int flags);
+ssize_t recv_direct_await(int file_index, void *buf, size_t len, int flags);
+
+// Move data between two file descriptors without copying it through user
+// space. One of them must be a pipe. Offsets of -1 mean the current file
+// position, and must be -1 for pipes. flags are SPLICE_F_* flags.
+ssize_t splice_await(int fd_in, off_t off_in, int fd_out, off_t off_out,
+                     size_t nbytes, unsigned flags);
+// Duplicate data from one pipe into another without consuming it.
+ssize_t tee_await(int fd_in, int fd_out, size_t nbytes, unsigned flags);
+// Send len bytes of in_fd starting at offset to out_sock through a pipe,
+// without copying them through user space. Returns the number of bytes sent,
+// which is less than len if the end of the file comes first, or a negative
+// errno if nothing could be sent.
+ssize_t sendfile_await(int out_sock, int in_fd, off_t offset, size_t len);
+
+// A buffer of a rocket_buf_ring_t holding received data.
+typedef struct {
+  void* data;
+  // Number of received bytes.
+  size_t len;
+  // Buffer ID within the ring.
+  unsigned short bid;
+} rocket_buf_t;
+
+// Create a ring of nr_buffers buffers of buffer_size bytes each, provided to
+// the kernel as buffer group bgid. nr_buffers must be a power of 2. Receive
+// requests on the ring only take a buffer once data arrives, so idle
+// connections hold no memory.
+rocket_buf_ring_t* rocket_buf_ring_create(rocket_engine_t* engine,
+                                          unsigned short bgid,
+                                          unsigned nr_buffers,
+                                          size_t buffer_size);
+void rocket_buf_ring_destroy(rocket_buf_ring_t* ring);
+// Give a buffer received into back to the ring.
+void rocket_buf_ring_release(rocket_buf_ring_t* ring, const rocket_buf_t* buf);
+
+// Receive into a buffer the kernel picks from the ring. On a positive return
+// value, buf describes the buffer, which must be released to the ring.
+// Returns -ENOBUFS if the ring has no buffer left.
+ssize_t recv_select_await(int sockfd, rocket_buf_ring_t* ring, int flags,
+                          rocket_buf_t* buf);
+
+// A stream of receives from one socket into buffers of a ring, backed by a
+// single multishot receive request which keeps receiving while the fiber is
+// busy with previous data.
+rocket_recv_stream_t* rocket_recv_stream_create(int sockfd,
+                                                rocket_buf_ring_t* ring,
+                                                int flags);
+// Same as recv_select_await for the next data of the stream. After
+// -ENOBUFS, the stream resumes on the next call, so release buffers first.
+ssize_t recv_stream_await(rocket_recv_stream_t* stream, rocket_buf_t* buf);
+// Stop receiving and free the stream. The socket stays open.
+int rocket_recv_stream_close_await(rocket_recv_stream_t* stream);
+
+// A chain of requests submitted together, each starting only once the
+// previous one completed. The fiber resumes once, when the whole chain
+// completes. A file opened into an explicit fixed file slot can be used by the
+// following requests of the same chain through that slot.
+//
+// By default, a request failing cancels the rest of the chain. Short reads and
+// writes count as failures.
+#define ROCKET_CHAIN_HARDLINK (1U << 0)  // Keep going after failures.
+
+// Create a chain holding up to max_requests requests, which must not exceed
+// the queue depth of the engine.
+rocket_chain_t* rocket_chain_create(unsigned max_requests, unsigned flags);
+void rocket_chain_destroy(rocket_chain_t* chain);
+// Remove all requests to build another chain.
+void rocket_chain_reset(rocket_chain_t* chain);
+// Append a request to the chain. Arguments must stay valid until the chain
+// completes. Returns the index of the request in the chain, or -ENOSPC.
+int rocket_chain_openat_direct(rocket_chain_t* chain, int dirfd,
+                               const char* pathname, int oflag, mode_t mode,
+                               unsigned file_index);
+int rocket_chain_readat(rocket_chain_t* chain, int fd, void* buf,
+                        size_t nbytes, off_t offset);
+int rocket_chain_readat_direct(rocket_chain_t* chain, int file_index,
+                               void* buf, size_t nbytes, off_t offset);
+int rocket_chain_writeat(rocket_chain_t* chain, int fd, const void* buf,
+                         size_t nbytes, off_t offset);
+int rocket_chain_writeat_direct(rocket_chain_t* chain, int file_index,
+                                const void* buf, size_t nbytes,
+                                off_t offset);
+int rocket_chain_close(rocket_chain_t* chain, int fd);
+int rocket_chain_close_direct(rocket_chain_t* chain, unsigned file_index);
+int rocket_chain_splice(rocket_chain_t* chain, int fd_in, off_t off_in,
+                        int fd_out, off_t off_out, size_t nbytes,
+                        unsigned flags);
+int rocket_chain_writev(rocket_chain_t* chain, int fd,
+                        const struct iovec* iov, int iovcnt, off_t offset);
+// flags is 0 or ROCKET_FSYNC_DATASYNC.
+int rocket_chain_fsync(rocket_chain_t* chain, int fd, unsigned flags);
+// Submit the chain and wait for all of its requests to complete. Returns 0 if
+// none of them failed, or the first negative result otherwise, which is
+// -ECANCELED if the chain stopped after a short read or write.
+int rocket_chain_submit_await(rocket_chain_t* chain);
+// Result of a request of the completed chain, as returned by the matching
+// *_await function, or -ECANCELED if the request didn't run.
+int rocket_chain_result(const rocket_chain_t* chain, unsigned index);
+
+// A log file many fibers append records to, with group commit: the records
+// appended while a flush is in flight are written and made durable together
+// by the next one, with a write linked to an fsync, and all their fibers
+// resume at once. The first I/O failure is sticky, as later records would
+// follow a gap. Canceling an appending fiber doesn't fail the log: its record
+// is still made durable, and its next await returns -ECANCELED instead.
+#define ROCKET_LOG_DATASYNC (1U << 0)  // Flush with fdatasync instead of fsync.
+
+// Create a log appending to fd from offset, e.g. the size of the file, which
+// must stay open until the log is destroyed. Returns NULL on failure.
+rocket_log_t* rocket_log_create(int fd, off_t offset, unsigned flags);
+// No append may be in progress.
+void rocket_log_destroy(rocket_log_t* log);
+// Append a record and wait until it is durable. buf must stay valid until
+// then. Returns the offset of the record in the file, or a negative errno.
+off_t rocket_log_append_await(rocket_log_t* log, const void* buf,
+                              size_t nbytes);
 
 #ifdef __cplusplus
 }
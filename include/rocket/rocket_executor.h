@@ -32,8 +32,11 @@ extern "C" {
 #endif
 
 rocket_executor_t* rocket_executor_create(rocket_engine_t* engine);
-void rocket_executor_submit_task(rocket_executor_t *executor,
-                                 rocket_task_func_t func, void *context);
+// Returns the fiber running the task, which is valid until the task returns,
+// or NULL on failure.
+rocket_fiber_t* rocket_executor_submit_task(rocket_executor_t *executor,
+                                            rocket_task_func_t func,
+                                            void *context);
 // Start executing the fibers in the executor.
 // Returns only after all existing fibers finish running.
 void rocket_executor_execute(rocket_executor_t* executor);
@@ -25,11 +25,25 @@
 
 #pragma once
 
+#include <stdint.h>
+
+#include <rocket/rocket_types.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 void rocket_fiber_yield();
+// Fail the requests the current fiber awaits from now on with -ETIME if they
+// don't complete within timeout_ns nanoseconds. The timeout applies to each
+// request on its own. 0, the default, means no timeout. Chains, receive
+// streams and multishot accepts are not affected.
+void rocket_fiber_set_io_timeout(uint64_t timeout_ns);
+// Cancel the request fiber is blocked on, which makes the await return
+// -ECANCELED. If fiber isn't blocked, or the request completes anyway, its
+// next await returns -ECANCELED instead. Requests of chains are not canceled.
+// fiber must not have finished.
+void rocket_fiber_cancel(rocket_fiber_t* fiber);
 
 #ifdef __cplusplus
 }
@@ -29,6 +29,10 @@ typedef struct rocket_engine rocket_engine_t;
 typedef struct rocket_executor rocket_executor_t;
 typedef struct rocket_fiber rocket_fiber_t;
 typedef struct rocket_future rocket_future_t;
+typedef struct rocket_buf_ring rocket_buf_ring_t;
+typedef struct rocket_recv_stream rocket_recv_stream_t;
+typedef struct rocket_chain rocket_chain_t;
+typedef struct rocket_log rocket_log_t;
 
 // Function running in the fiber.
 typedef void *(*rocket_task_func_t)(void *context);
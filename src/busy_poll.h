@@ -0,0 +1,62 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Andrew Rogers <andrurogerz@gmail.com>, Hechao Li
+ * <hechaol@outlook.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+// Window an executor busy-polls for completions in before sleeping in the
+// kernel, adapted to how long completions recently took to arrive. See
+// busy_poll_us in rocket_engine_config_t.
+typedef struct {
+  // Configured window, which is also the largest.
+  uint64_t max_ns;
+  // Current window. 0 means no spinning.
+  uint64_t window_ns;
+  // Moving average of the time the executor waited for completions.
+  uint64_t avg_wait_ns;
+} busy_poll_t;
+
+static inline void busy_poll_init(busy_poll_t* poll, unsigned busy_poll_us) {
+  poll->max_ns = busy_poll_us * 1000ULL;
+  poll->window_ns = poll->max_ns;
+  poll->avg_wait_ns = 0;
+}
+
+// Account for a wait of wait_ns for completions. Spinning about twice the
+// average wait catches most of them, while completions arriving much later
+// than the configured window are too sparse for spinning to pay off.
+static inline void busy_poll_update(busy_poll_t* poll, uint64_t wait_ns) {
+  poll->avg_wait_ns = (poll->avg_wait_ns * 7 + wait_ns) / 8;
+  if (poll->avg_wait_ns > 4 * poll->max_ns) {
+    poll->window_ns = 0;
+  } else if (2 * poll->avg_wait_ns < poll->max_ns / 8) {
+    poll->window_ns = poll->max_ns / 8;
+  } else if (2 * poll->avg_wait_ns < poll->max_ns) {
+    poll->window_ns = 2 * poll->avg_wait_ns;
+  } else {
+    poll->window_ns = poll->max_ns;
+  }
+}
@@ -0,0 +1,261 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Andrew Rogers <andrurogerz@gmail.com>, Hechao Li
+ * <hechaol@outlook.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Backend independent part of rocket engine, dispatching to the backend
+// selected at creation.
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rocket/rocket_engine.h>
+
+#include "rocket_engine.h"
+#include "rocket_executor.h"
+#include "rocket_fiber.h"
+
+void rocket_engine_config_init(rocket_engine_config_t* config,
+                               size_t queue_depth) {
+  memset(config, 0, sizeof(*config));
+  config->backend = ROCKET_ENGINE_IO_URING;
+  config->queue_depth = queue_depth;
+  config->sq_thread_cpu = -1;
+}
+
+rocket_engine_t* rocket_engine_create(size_t queue_depth) {
+  rocket_engine_config_t config;
+  rocket_engine_config_init(&config, queue_depth);
+  return rocket_engine_create_ex(&config);
+}
+
+rocket_engine_t* rocket_engine_create_ex(const rocket_engine_config_t* config) {
+  rocket_engine_config_t actual = *config;
+  if (actual.offload_threads == 0) {
+    actual.offload_threads = DEFAULT_OFFLOAD_THREADS;
+  }
+
+  switch (actual.backend) {
+    case ROCKET_ENGINE_IO_URING:
+      return rocket_engine_uring_create(&actual);
+    case ROCKET_ENGINE_EPOLL:
+      return rocket_engine_epoll_create(&actual);
+    default:
+      fprintf(stderr, "Unknown engine backend %d\n", actual.backend);
+      return NULL;
+  }
+}
+
+void rocket_engine_destroy(rocket_engine_t* engine) {
+  engine->ops->destroy(engine);
+}
+
+void rocket_engine_get_config(const rocket_engine_t* engine,
+                              rocket_engine_config_t* config) {
+  *config = engine->config;
+}
+
+void rocket_engine_get_stats(const rocket_engine_t* engine,
+                             rocket_engine_stats_t* stats) {
+  *stats = engine->stats;
+}
+
+void rocket_engine_set_submit_batch_size(rocket_engine_t* engine,
+                                         size_t batch_size) {
+  engine->config.submit_batch_size = batch_size;
+}
+
+int rocket_engine_await_completions(rocket_engine_t* engine,
+                                    rocket_future_t** futures,
+                                    size_t max_futures) {
+  return engine->ops->await_completions(engine, futures, max_futures);
+}
+
+size_t rocket_engine_detached_requests(rocket_engine_t* engine) {
+  return engine->detached_requests;
+}
+
+int rocket_engine_cancel(rocket_engine_t* engine, rocket_future_t* request) {
+  return engine->ops->cancel(engine, request);
+}
+
+void* rocket_direct_io_alloc(size_t size) {
+  size_t aligned_size = (size + ROCKET_DIRECT_IO_ALIGNMENT - 1) /
+                        ROCKET_DIRECT_IO_ALIGNMENT * ROCKET_DIRECT_IO_ALIGNMENT;
+  void* buf = NULL;
+  if (posix_memalign(&buf, ROCKET_DIRECT_IO_ALIGNMENT, aligned_size) != 0) {
+    return NULL;
+  }
+  return buf;
+}
+
+void rocket_direct_io_free(void* buf) {
+  free(buf);
+}
+
+// Operations of the engine of the current fiber.
+static const rocket_engine_ops_t* get_ops(void) {
+  return rocket_executor_get_engine(get_current_fiber()->executor)->ops;
+}
+
+int openat_await(int dirfd, const char* pathname, int oflag, ...) {
+  mode_t pmode = 0;
+  if (__OPEN_NEEDS_MODE(oflag)) {
+    va_list args;
+    va_start(args, oflag);
+    pmode = va_arg(args, mode_t);
+    va_end(args);
+  }
+  return get_ops()->openat(dirfd, pathname, oflag, pmode);
+}
+
+ssize_t readat_await(int fd, void* buf, size_t nbytes, off_t offset) {
+  return get_ops()->readat(fd, buf, nbytes, offset);
+}
+
+ssize_t writeat_await(int fd, const void* buf, size_t nbytes, off_t offset) {
+  return get_ops()->writeat(fd, buf, nbytes, offset);
+}
+
+int close_await(int fd) {
+  return get_ops()->close(fd);
+}
+
+ssize_t readv_await(int fd, const struct iovec* iov, int iovcnt,
+                    off_t offset) {
+  return get_ops()->readv(fd, iov, iovcnt, offset);
+}
+
+ssize_t writev_await(int fd, const struct iovec* iov, int iovcnt,
+                     off_t offset) {
+  return get_ops()->writev(fd, iov, iovcnt, offset);
+}
+
+int accept_await(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
+                 int flags) {
+  return get_ops()->accept(sockfd, addr, addrlen, flags);
+}
+
+int socket_await(int domain, int type, int protocol) {
+  return get_ops()->socket(domain, type, protocol);
+}
+
+int connect_await(int sockfd, const struct sockaddr* addr, socklen_t addrlen) {
+  return get_ops()->connect(sockfd, addr, addrlen);
+}
+
+int shutdown_await(int sockfd, int how) {
+  return get_ops()->shutdown(sockfd, how);
+}
+
+// Binding and listening never wait, so they run right away on every
+// backend, which saves a round trip through the engine.
+int bind_await(int sockfd, const struct sockaddr* addr, socklen_t addrlen) {
+  return bind(sockfd, addr, addrlen) < 0 ? -errno : 0;
+}
+
+int listen_await(int sockfd, int backlog) {
+  return listen(sockfd, backlog) < 0 ? -errno : 0;
+}
+
+ssize_t send_await(int sockfd, const void *buf, size_t len, int flags) {
+  return get_ops()->send(sockfd, buf, len, flags);
+}
+
+ssize_t recv_await(int sockfd, void *buf, size_t len, int flags) {
+  return get_ops()->recv(sockfd, buf, len, flags);
+}
+
+ssize_t sendmsg_await(int sockfd, const struct msghdr* msg, int flags) {
+  return get_ops()->sendmsg(sockfd, msg, flags);
+}
+
+ssize_t recvmsg_await(int sockfd, struct msghdr* msg, int flags) {
+  return get_ops()->recvmsg(sockfd, msg, flags);
+}
+
+int rocket_sleep_await(uint64_t duration_ns) {
+  return get_ops()->sleep(duration_ns);
+}
+
+int cancel_fd_await(int fd) {
+  return get_ops()->cancel_fd(fd);
+}
+
+int fsync_await(int fd) {
+  return get_ops()->fsync(fd, /*flags=*/0);
+}
+
+int fdatasync_await(int fd) {
+  return get_ops()->fsync(fd, ROCKET_FSYNC_DATASYNC);
+}
+
+int sync_file_range_await(int fd, off_t offset, off_t nbytes,
+                          unsigned flags) {
+  return get_ops()->sync_file_range(fd, offset, nbytes, flags);
+}
+
+int statx_await(int dirfd, const char* pathname, int flags, unsigned mask,
+                struct statx* statxbuf) {
+  return get_ops()->statx(dirfd, pathname, flags, mask, statxbuf);
+}
+
+int fallocate_await(int fd, int mode, off_t offset, off_t len) {
+  return get_ops()->fallocate(fd, mode, offset, len);
+}
+
+int ftruncate_await(int fd, off_t length) {
+  return get_ops()->ftruncate(fd, length);
+}
+
+int unlinkat_await(int dirfd, const char* pathname, int flags) {
+  return get_ops()->unlinkat(dirfd, pathname, flags);
+}
+
+int renameat_await(int olddirfd, const char* oldpath, int newdirfd,
+                   const char* newpath, unsigned flags) {
+  return get_ops()->renameat(olddirfd, oldpath, newdirfd, newpath, flags);
+}
+
+int mkdirat_await(int dirfd, const char* pathname, mode_t mode) {
+  return get_ops()->mkdirat(dirfd, pathname, mode);
+}
+
+int fadvise_await(int fd, off_t offset, off_t len, int advice) {
+  return get_ops()->fadvise(fd, offset, len, advice);
+}
+
+int madvise_await(void* addr, size_t len, int advice) {
+  return get_ops()->madvise(addr, len, advice);
+}
+
+int rocket_prefetch(int fd, off_t offset, off_t len) {
+  return get_ops()->prefetch(fd, offset, len);
+}
+
+long rocket_offload_await(rocket_offload_func_t func, void* arg) {
+  return get_ops()->offload(func, arg);
+}
@@ -25,8 +25,87 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include <rocket/rocket_engine.h>
 
 #include "rocket_future.h"
 
-rocket_future_t* rocket_engine_await_next(rocket_engine_t* engine);
+// Operations of an engine backend.
+typedef struct {
+  void (*destroy)(rocket_engine_t* engine);
+  // See rocket_engine_await_completions.
+  int (*await_completions)(rocket_engine_t* engine, rocket_future_t** futures,
+                           size_t max_futures);
+  // See rocket_engine_cancel.
+  int (*cancel)(rocket_engine_t* engine, rocket_future_t* request);
+
+  // Requests every backend supports, issued by the current fiber. See the
+  // matching *_await functions.
+  int (*openat)(int dirfd, const char* pathname, int oflag, mode_t mode);
+  ssize_t (*readat)(int fd, void* buf, size_t nbytes, off_t offset);
+  ssize_t (*writeat)(int fd, const void* buf, size_t nbytes, off_t offset);
+  int (*close)(int fd);
+  ssize_t (*readv)(int fd, const struct iovec* iov, int iovcnt, off_t offset);
+  ssize_t (*writev)(int fd, const struct iovec* iov, int iovcnt,
+                    off_t offset);
+  int (*accept)(int sockfd, struct sockaddr* addr, socklen_t* addrlen,
+                int flags);
+  int (*socket)(int domain, int type, int protocol);
+  int (*connect)(int sockfd, const struct sockaddr* addr, socklen_t addrlen);
+  int (*shutdown)(int sockfd, int how);
+  ssize_t (*send)(int sockfd, const void* buf, size_t len, int flags);
+  ssize_t (*recv)(int sockfd, void* buf, size_t len, int flags);
+  ssize_t (*sendmsg)(int sockfd, const struct msghdr* msg, int flags);
+  ssize_t (*recvmsg)(int sockfd, struct msghdr* msg, int flags);
+  int (*sleep)(uint64_t duration_ns);
+  int (*cancel_fd)(int fd);
+  int (*fsync)(int fd, unsigned flags);
+  int (*sync_file_range)(int fd, off_t offset, off_t nbytes, unsigned flags);
+  int (*statx)(int dirfd, const char* pathname, int flags, unsigned mask,
+               struct statx* statxbuf);
+  int (*fallocate)(int fd, int mode, off_t offset, off_t len);
+  int (*ftruncate)(int fd, off_t length);
+  int (*unlinkat)(int dirfd, const char* pathname, int flags);
+  int (*renameat)(int olddirfd, const char* oldpath, int newdirfd,
+                  const char* newpath, unsigned flags);
+  int (*mkdirat)(int dirfd, const char* pathname, mode_t mode);
+  int (*fadvise)(int fd, off_t offset, off_t len, int advice);
+  int (*madvise)(void* addr, size_t len, int advice);
+  int (*prefetch)(int fd, off_t offset, off_t len);
+  long (*offload)(rocket_offload_func_t func, void* arg);
+} rocket_engine_ops_t;
+
+// Number of offload threads when the config leaves it to the engine.
+#define DEFAULT_OFFLOAD_THREADS 4
+
+// Common part of all engine backends.
+struct rocket_engine {
+  const rocket_engine_ops_t* ops;
+  // Configuration in effect.
+  rocket_engine_config_t config;
+  // Number of in-flight requests no fiber waits for but whose completion
+  // still has to be handled.
+  size_t detached_requests;
+  // See rocket_engine_get_stats.
+  rocket_engine_stats_t stats;
+};
+
+rocket_engine_t* rocket_engine_uring_create(
+    const rocket_engine_config_t* config);
+rocket_engine_t* rocket_engine_epoll_create(
+    const rocket_engine_config_t* config);
+
+// Submit queued requests and wait until at least one request completes.
+// Stores up to max_futures completed futures in futures.
+// Returns the number of stored futures, -1 on failure.
+int rocket_engine_await_completions(rocket_engine_t* engine,
+                                    rocket_future_t** futures,
+                                    size_t max_futures);
+// Number of in-flight requests no fiber waits for but whose completion still
+// has to be handled, e.g. buffer release notifications of zero-copy sends.
+size_t rocket_engine_detached_requests(rocket_engine_t* engine);
+// Ask the engine to cancel request. The request then completes with
+// -ECANCELED unless it completes first. Never blocks, and returns -EBUSY if
+// the engine has no room to queue the cancellation right away.
+int rocket_engine_cancel(rocket_engine_t* engine, rocket_future_t* request);
@@ -0,0 +1,886 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Andrew Rogers <andrurogerz@gmail.com>, Hechao Li
+ * <hechaol@outlook.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// For accept4, sync_file_range, statx and renameat2.
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <rocket/rocket_engine.h>
+#include <rocket/rocket_fiber.h>
+
+#include "rocket_engine.h"
+#include "rocket_executor.h"
+#include "rocket_fiber.h"
+#include "rocket_future.h"
+#include "rocket_offload.h"
+
+// Maximum number of events collected from epoll at once.
+#define EVENT_BATCH_SIZE 64
+
+// A request a fiber waits for: readiness of a file descriptor, a timer, or a
+// job running on the offload pool.
+typedef struct {
+  rocket_future_t future;
+  // Node in the waiters of fd, then in the ready requests of the engine.
+  dlist_node_t node;
+  int fd;
+  uint32_t events;
+  // Node in the timers of the engine if the request has a deadline.
+  dlist_node_t timer_node;
+  uint64_t deadline_ns;
+  // Result of the request when the deadline expires.
+  int timeout_result;
+  // Job of an offloaded request. Its function is NULL otherwise.
+  rocket_offload_job_t job;
+} epoll_request_t;
+
+// Requests waiting for readiness of a file descriptor.
+typedef struct {
+  dlist_node_t waiters;
+} fd_entry_t;
+
+// The epoll implementation of rocket engine.
+typedef struct {
+  rocket_engine_t base;
+  int epfd;
+  // Entries indexed by file descriptor, allocated on first use.
+  fd_entry_t** fds;
+  size_t nr_fds;
+  // Requests with a deadline, sorted by deadline.
+  dlist_node_t timers;
+  // Completed requests not handed to the executor yet.
+  dlist_node_t ready;
+  rocket_offload_pool_t* offload;
+} epoll_engine_t;
+
+static const rocket_engine_ops_t epoll_engine_ops;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static epoll_engine_t* to_epoll_engine(rocket_engine_t* engine) {
+  return container_of(engine, epoll_engine_t, base);
+}
+
+static epoll_engine_t* get_epoll_engine(void) {
+  return to_epoll_engine(
+      rocket_executor_get_engine(get_current_fiber()->executor));
+}
+
+rocket_engine_t* rocket_engine_epoll_create(
+    const rocket_engine_config_t* config) {
+  epoll_engine_t* engine = malloc(sizeof(epoll_engine_t));
+  if (engine == NULL) {
+    return NULL;
+  }
+
+  engine->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (engine->epfd < 0) {
+    perror("epoll_create1");
+    free(engine);
+    return NULL;
+  }
+  engine->offload = rocket_offload_pool_create(config->offload_threads);
+  if (engine->offload == NULL) {
+    close(engine->epfd);
+    free(engine);
+    return NULL;
+  }
+  struct epoll_event event;
+  event.events = EPOLLIN;
+  event.data.fd = rocket_offload_pool_eventfd(engine->offload);
+  if (epoll_ctl(engine->epfd, EPOLL_CTL_ADD, event.data.fd, &event) < 0) {
+    perror("epoll_ctl");
+    rocket_offload_pool_destroy(engine->offload);
+    close(engine->epfd);
+    free(engine);
+    return NULL;
+  }
+
+  engine->base.ops = &epoll_engine_ops;
+  engine->base.config = *config;
+  // Busy-polling is specific to io_uring.
+  engine->base.config.busy_poll_us = 0;
+  engine->base.config.napi_busy_poll_us = 0;
+  engine->base.config.flags &= ~ROCKET_ENGINE_NAPI_PREFER_BUSY_POLL;
+  engine->base.detached_requests = 0;
+  memset(&engine->base.stats, 0, sizeof(engine->base.stats));
+  engine->fds = NULL;
+  engine->nr_fds = 0;
+  dlist_init(&engine->timers);
+  dlist_init(&engine->ready);
+  return &engine->base;
+}
+
+static void epoll_destroy(rocket_engine_t* base) {
+  epoll_engine_t* engine = to_epoll_engine(base);
+  rocket_offload_pool_destroy(engine->offload);
+  close(engine->epfd);
+  for (size_t i = 0; i < engine->nr_fds; i++) {
+    free(engine->fds[i]);
+  }
+  free(engine->fds);
+  free(engine);
+}
+
+static fd_entry_t* get_fd_entry(epoll_engine_t* engine, int fd) {
+  // fd is valid, since a syscall on it just returned EAGAIN.
+  if ((size_t)fd >= engine->nr_fds) {
+    size_t nr_fds = engine->nr_fds > 0 ? engine->nr_fds : 64;
+    while (nr_fds <= (size_t)fd) {
+      nr_fds *= 2;
+    }
+    fd_entry_t** fds = realloc(engine->fds, nr_fds * sizeof(fd_entry_t*));
+    if (fds == NULL) {
+      return NULL;
+    }
+    memset(fds + engine->nr_fds, 0,
+           (nr_fds - engine->nr_fds) * sizeof(fd_entry_t*));
+    engine->fds = fds;
+    engine->nr_fds = nr_fds;
+  }
+
+  if (engine->fds[fd] == NULL) {
+    fd_entry_t* entry = malloc(sizeof(fd_entry_t));
+    if (entry == NULL) {
+      return NULL;
+    }
+    dlist_init(&entry->waiters);
+    engine->fds[fd] = entry;
+  }
+  return engine->fds[fd];
+}
+
+static void init_request(epoll_request_t* request, rocket_fiber_t* fiber) {
+  memset(request, 0, sizeof(*request));
+  request->future.fiber = fiber;
+  request->future.error = -1;
+  request->future.result = -1;
+  request->fd = -1;
+}
+
+// Insert request into the timers, which are sorted by deadline.
+static void add_timer(epoll_engine_t* engine, epoll_request_t* request,
+                      uint64_t deadline_ns, int timeout_result) {
+  request->deadline_ns = deadline_ns;
+  request->timeout_result = timeout_result;
+
+  dlist_node_t* prev = engine->timers.prev;
+  while (prev != &engine->timers &&
+         container_of(prev, epoll_request_t, timer_node)->deadline_ns >
+             deadline_ns) {
+    prev = prev->prev;
+  }
+  dlist_node_t* next = prev->next;
+  dlist_link_nodes(prev, &request->timer_node);
+  dlist_link_nodes(&request->timer_node, next);
+}
+
+// Complete request with result and queue it for the executor.
+static void complete_request(epoll_engine_t* engine, epoll_request_t* request,
+                             int result) {
+  if (dlist_node_in_list(&request->node)) {
+    dlist_remove_node(&request->node);
+  }
+  if (dlist_node_in_list(&request->timer_node)) {
+    dlist_remove_node(&request->timer_node);
+  }
+  request->future.completed = true;
+  request->future.error = 0;
+  request->future.result = result;
+  dlist_push_tail(&engine->ready, &request->node);
+}
+
+// Wake the requests waiting for events on fd.
+static void wake_fd(epoll_engine_t* engine, int fd, uint32_t events) {
+  if ((size_t)fd >= engine->nr_fds || engine->fds[fd] == NULL) {
+    return;
+  }
+  // Errors and hang-ups are reported to every waiter through the retried
+  // syscall.
+  if (events & (EPOLLERR | EPOLLHUP)) {
+    events |= EPOLLIN | EPOLLOUT;
+  }
+  if (events & EPOLLRDHUP) {
+    events |= EPOLLIN;
+  }
+
+  dlist_node_t* waiters = &engine->fds[fd]->waiters;
+  dlist_node_t* node = waiters->next;
+  while (node != waiters) {
+    dlist_node_t* next = node->next;
+    epoll_request_t* request = container_of(node, epoll_request_t, node);
+    if (request->events & events) {
+      complete_request(engine, request, 0);
+    }
+    node = next;
+  }
+}
+
+// Complete the requests waiting for fd with result. Returns their number.
+static int complete_fd(epoll_engine_t* engine, int fd, int result) {
+  if (fd < 0 || (size_t)fd >= engine->nr_fds || engine->fds[fd] == NULL) {
+    return 0;
+  }
+  int count = 0;
+  dlist_node_t* waiters = &engine->fds[fd]->waiters;
+  while (!dlist_is_empty(waiters)) {
+    complete_request(engine,
+                     container_of(waiters->next, epoll_request_t, node),
+                     result);
+    count++;
+  }
+  return count;
+}
+
+static void reap_offload(epoll_engine_t* engine) {
+  dlist_node_t done;
+  dlist_init(&done);
+  rocket_offload_pool_reap(engine->offload, &done);
+  while (!dlist_is_empty(&done)) {
+    dlist_node_t* node = dlist_pop_head(&done);
+    rocket_offload_job_t* job =
+        container_of(node, rocket_offload_job_t, list_node);
+    epoll_request_t* request = container_of(job, epoll_request_t, job);
+    complete_request(engine, request, job->result);
+  }
+}
+
+static void expire_timers(epoll_engine_t* engine) {
+  uint64_t now = now_ns();
+  while (!dlist_is_empty(&engine->timers)) {
+    epoll_request_t* request =
+        container_of(engine->timers.next, epoll_request_t, timer_node);
+    if (request->deadline_ns > now) {
+      break;
+    }
+    complete_request(engine, request, request->timeout_result);
+  }
+}
+
+// Milliseconds until the first deadline, rounded up, or -1 if none.
+static int get_wait_timeout_ms(epoll_engine_t* engine) {
+  if (dlist_is_empty(&engine->timers)) {
+    return -1;
+  }
+  epoll_request_t* request =
+      container_of(engine->timers.next, epoll_request_t, timer_node);
+  uint64_t now = now_ns();
+  if (request->deadline_ns <= now) {
+    return 0;
+  }
+  return (request->deadline_ns - now + 999999) / 1000000;
+}
+
+static int epoll_await_completions(rocket_engine_t* base,
+                                   rocket_future_t** futures,
+                                   size_t max_futures) {
+  epoll_engine_t* engine = to_epoll_engine(base);
+  if (dlist_is_empty(&engine->ready)) {
+    struct epoll_event events[EVENT_BATCH_SIZE];
+    int count;
+    do {
+      count = epoll_wait(engine->epfd, events, EVENT_BATCH_SIZE,
+                         get_wait_timeout_ms(engine));
+    } while (count < 0 && errno == EINTR);
+    if (count < 0) {
+      perror("epoll_wait");
+      return -1;
+    }
+
+    int offload_fd = rocket_offload_pool_eventfd(engine->offload);
+    for (int i = 0; i < count; i++) {
+      if (events[i].data.fd == offload_fd) {
+        reap_offload(engine);
+      } else {
+        wake_fd(engine, events[i].data.fd, events[i].events);
+      }
+    }
+    expire_timers(engine);
+  }
+
+  size_t count = 0;
+  while (count < max_futures && !dlist_is_empty(&engine->ready)) {
+    epoll_request_t* request =
+        container_of(dlist_pop_head(&engine->ready), epoll_request_t, node);
+    futures[count++] = &request->future;
+  }
+  return count;
+}
+
+static int epoll_cancel(rocket_engine_t* base, rocket_future_t* future) {
+  epoll_engine_t* engine = to_epoll_engine(base);
+  epoll_request_t* request = container_of(future, epoll_request_t, future);
+  // Jobs already handed to the offload pool run to completion.
+  if (!request->future.completed && request->job.func == NULL) {
+    complete_request(engine, request, -ECANCELED);
+  }
+  return 0;
+}
+
+// Block the current fiber until fd may be ready for events. Returns 0, or
+// -ETIME if the I/O timeout of the fiber expires first.
+static int wait_fd(int fd, uint32_t events) {
+  rocket_fiber_t* fiber = get_current_fiber();
+  epoll_engine_t* engine = get_epoll_engine();
+  if (rocket_fiber_take_cancel(fiber)) {
+    return -ECANCELED;
+  }
+
+  fd_entry_t* entry = get_fd_entry(engine, fd);
+  if (entry == NULL) {
+    return -ENOMEM;
+  }
+  // Register the file descriptor for good, edge-triggered. It leaves the
+  // interest list on its own once closed, so try again every time.
+  struct epoll_event event;
+  event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  event.data.fd = fd;
+  if (epoll_ctl(engine->epfd, EPOLL_CTL_ADD, fd, &event) < 0 &&
+      errno != EEXIST) {
+    return -errno;
+  }
+
+  epoll_request_t request;
+  init_request(&request, fiber);
+  request.fd = fd;
+  request.events = events;
+  dlist_push_tail(&entry->waiters, &request.node);
+  if (fiber->io_timeout_ns > 0) {
+    add_timer(engine, &request, now_ns() + fiber->io_timeout_ns, -ETIME);
+  }
+
+  bool canceled;
+  if (rocket_future_await_request(&request.future, &request.future,
+                                  &canceled) < 0) {
+    perror("rocket_future_await");
+    return -1;
+  }
+  return request.future.result;
+}
+
+static bool would_block(int err) {
+  return err == EAGAIN || err == EWOULDBLOCK;
+}
+
+static ssize_t epoll_send(int sockfd, const void* buf, size_t len, int flags) {
+  // Like a blocking send, return once everything is sent.
+  size_t total = 0;
+  do {
+    ssize_t nbytes = send(sockfd, (const char*)buf + total, len - total,
+                          flags | MSG_DONTWAIT);
+    if (nbytes >= 0) {
+      total += nbytes;
+      continue;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    int ret = would_block(errno) ? wait_fd(sockfd, EPOLLOUT) : -errno;
+    if (ret < 0) {
+      return total > 0 ? (ssize_t)total : ret;
+    }
+  } while (total < len);
+  return total;
+}
+
+static ssize_t epoll_recv(int sockfd, void* buf, size_t len, int flags) {
+  size_t total = 0;
+  while (true) {
+    ssize_t nbytes = recv(sockfd, (char*)buf + total, len - total,
+                          flags | MSG_DONTWAIT);
+    if (nbytes > 0) {
+      total += nbytes;
+      if (!(flags & MSG_WAITALL) || total == len) {
+        return total;
+      }
+      continue;
+    }
+    if (nbytes == 0) {
+      return total;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    int ret = would_block(errno) ? wait_fd(sockfd, EPOLLIN) : -errno;
+    if (ret < 0) {
+      return total > 0 ? (ssize_t)total : ret;
+    }
+  }
+}
+
+static ssize_t epoll_sendmsg(int sockfd, const struct msghdr* msg,
+                             int flags) {
+  while (true) {
+    ssize_t nbytes = sendmsg(sockfd, msg, flags | MSG_DONTWAIT);
+    if (nbytes >= 0) {
+      return nbytes;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    int ret = would_block(errno) ? wait_fd(sockfd, EPOLLOUT) : -errno;
+    if (ret < 0) {
+      return ret;
+    }
+  }
+}
+
+static ssize_t epoll_recvmsg(int sockfd, struct msghdr* msg, int flags) {
+  while (true) {
+    ssize_t nbytes = recvmsg(sockfd, msg, flags | MSG_DONTWAIT);
+    if (nbytes >= 0) {
+      return nbytes;
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    int ret = would_block(errno) ? wait_fd(sockfd, EPOLLIN) : -errno;
+    if (ret < 0) {
+      return ret;
+    }
+  }
+}
+
+// accept and connect have no per-call non-blocking flag, so make fd
+// non-blocking for good. Toggling the flag around each call would race with
+// other threads sharing the open file description, e.g. executors accepting
+// from one listening socket, and leave some of them blocking.
+static int set_nonblocking(int fd) {
+  int fl = fcntl(fd, F_GETFL);
+  if (fl < 0) {
+    return -errno;
+  }
+  if (!(fl & O_NONBLOCK) && fcntl(fd, F_SETFL, fl | O_NONBLOCK) < 0) {
+    return -errno;
+  }
+  return 0;
+}
+
+static int epoll_accept(int sockfd, struct sockaddr* addr, socklen_t* addrlen,
+                        int flags) {
+  int ret = set_nonblocking(sockfd);
+  if (ret < 0) {
+    return ret;
+  }
+  while (true) {
+    int fd = accept4(sockfd, addr, addrlen, flags);
+    int err = errno;
+    if (fd >= 0) {
+      return fd;
+    }
+    if (err == EINTR) {
+      continue;
+    }
+    ret = would_block(err) ? wait_fd(sockfd, EPOLLIN) : -err;
+    if (ret < 0) {
+      return ret;
+    }
+  }
+}
+
+static int epoll_socket(int domain, int type, int protocol) {
+  int fd = socket(domain, type, protocol);
+  return fd >= 0 ? fd : -errno;
+}
+
+static int epoll_connect(int sockfd, const struct sockaddr* addr,
+                         socklen_t addrlen) {
+  // Start connecting without blocking and wait until the socket becomes
+  // writable, which is when the attempt finishes.
+  int ret = set_nonblocking(sockfd);
+  if (ret < 0) {
+    return ret;
+  }
+  ret = connect(sockfd, addr, addrlen);
+  int err = errno;
+  if (ret == 0) {
+    return 0;
+  }
+  if (err != EINPROGRESS) {
+    return -err;
+  }
+
+  ret = wait_fd(sockfd, EPOLLOUT);
+  if (ret < 0) {
+    return ret;
+  }
+  socklen_t len = sizeof(err);
+  if (getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
+    return -errno;
+  }
+  return -err;
+}
+
+static int epoll_shutdown(int sockfd, int how) {
+  return shutdown(sockfd, how) < 0 ? -errno : 0;
+}
+
+// Run func with context on the offload pool and wait for its result. File
+// requests have no readiness to wait for, so they run there too.
+static long epoll_offload(rocket_offload_func_t func, void* context) {
+  rocket_fiber_t* fiber = get_current_fiber();
+  epoll_engine_t* engine = get_epoll_engine();
+  if (rocket_fiber_take_cancel(fiber)) {
+    return -ECANCELED;
+  }
+
+  epoll_request_t request;
+  init_request(&request, fiber);
+  request.job.func = func;
+  request.job.context = context;
+  int ret = rocket_offload_pool_submit(engine->offload, &request.job);
+  if (ret < 0) {
+    return ret;
+  }
+
+  bool canceled;
+  if (rocket_future_await_request(&request.future, &request.future,
+                                  &canceled) < 0) {
+    perror("rocket_future_await");
+    return -1;
+  }
+  return request.job.result;
+}
+
+typedef struct {
+  int dirfd;
+  const char* pathname;
+  int oflag;
+  mode_t mode;
+} openat_job_t;
+
+static long run_openat(void* context) {
+  openat_job_t* job = context;
+  int fd = openat(job->dirfd, job->pathname, job->oflag, job->mode);
+  return fd >= 0 ? fd : -errno;
+}
+
+static int epoll_openat(int dirfd, const char* pathname, int oflag,
+                        mode_t mode) {
+  openat_job_t job = {dirfd, pathname, oflag, mode};
+  return epoll_offload(run_openat, &job);
+}
+
+typedef struct {
+  int fd;
+  void* buf;
+  size_t nbytes;
+  // -1 for the current file position.
+  off_t offset;
+  const struct iovec* iov;
+  int iovcnt;
+} rw_job_t;
+
+static long run_readat(void* context) {
+  rw_job_t* job = context;
+  ssize_t nbytes = job->offset == -1
+                       ? read(job->fd, job->buf, job->nbytes)
+                       : pread(job->fd, job->buf, job->nbytes, job->offset);
+  return nbytes >= 0 ? nbytes : -errno;
+}
+
+static long run_writeat(void* context) {
+  rw_job_t* job = context;
+  ssize_t nbytes = job->offset == -1
+                       ? write(job->fd, job->buf, job->nbytes)
+                       : pwrite(job->fd, job->buf, job->nbytes, job->offset);
+  return nbytes >= 0 ? nbytes : -errno;
+}
+
+static long run_readv(void* context) {
+  rw_job_t* job = context;
+  ssize_t nbytes = job->offset == -1
+                       ? readv(job->fd, job->iov, job->iovcnt)
+                       : preadv(job->fd, job->iov, job->iovcnt, job->offset);
+  return nbytes >= 0 ? nbytes : -errno;
+}
+
+static long run_writev(void* context) {
+  rw_job_t* job = context;
+  ssize_t nbytes = job->offset == -1
+                       ? writev(job->fd, job->iov, job->iovcnt)
+                       : pwritev(job->fd, job->iov, job->iovcnt, job->offset);
+  return nbytes >= 0 ? nbytes : -errno;
+}
+
+static ssize_t epoll_readat(int fd, void* buf, size_t nbytes, off_t offset) {
+  rw_job_t job = {fd, buf, nbytes, offset, NULL, 0};
+  return epoll_offload(run_readat, &job);
+}
+
+static ssize_t epoll_writeat(int fd, const void* buf, size_t nbytes,
+                             off_t offset) {
+  rw_job_t job = {fd, (void*)buf, nbytes, offset, NULL, 0};
+  return epoll_offload(run_writeat, &job);
+}
+
+static ssize_t epoll_readv(int fd, const struct iovec* iov, int iovcnt,
+                           off_t offset) {
+  rw_job_t job = {fd, NULL, 0, offset, iov, iovcnt};
+  return epoll_offload(run_readv, &job);
+}
+
+static ssize_t epoll_writev(int fd, const struct iovec* iov, int iovcnt,
+                            off_t offset) {
+  rw_job_t job = {fd, NULL, 0, offset, iov, iovcnt};
+  return epoll_offload(run_writev, &job);
+}
+
+typedef struct {
+  int fd;
+  unsigned flags;
+  off_t offset;
+  off_t nbytes;
+} sync_job_t;
+
+static long run_fsync(void* context) {
+  sync_job_t* job = context;
+  int ret = (job->flags & ROCKET_FSYNC_DATASYNC) ? fdatasync(job->fd)
+                                                 : fsync(job->fd);
+  return ret < 0 ? -errno : 0;
+}
+
+static long run_sync_file_range(void* context) {
+  sync_job_t* job = context;
+  int ret = sync_file_range(job->fd, job->offset, job->nbytes, job->flags);
+  return ret < 0 ? -errno : 0;
+}
+
+static int epoll_fsync(int fd, unsigned flags) {
+  sync_job_t job = {fd, flags, 0, 0};
+  return epoll_offload(run_fsync, &job);
+}
+
+static int epoll_sync_file_range(int fd, off_t offset, off_t nbytes,
+                                 unsigned flags) {
+  sync_job_t job = {fd, flags, offset, nbytes};
+  return epoll_offload(run_sync_file_range, &job);
+}
+
+typedef struct {
+  int dirfd;
+  const char* pathname;
+  int flags;
+  unsigned mask;
+  struct statx* statxbuf;
+} statx_job_t;
+
+static long run_statx(void* context) {
+  statx_job_t* job = context;
+  int ret = statx(job->dirfd, job->pathname, job->flags, job->mask,
+                  job->statxbuf);
+  return ret < 0 ? -errno : 0;
+}
+
+static int epoll_statx(int dirfd, const char* pathname, int flags,
+                       unsigned mask, struct statx* statxbuf) {
+  statx_job_t job = {dirfd, pathname, flags, mask, statxbuf};
+  return epoll_offload(run_statx, &job);
+}
+
+typedef struct {
+  int fd;
+  int mode;
+  off_t offset;
+  off_t len;
+} fallocate_job_t;
+
+static long run_fallocate(void* context) {
+  fallocate_job_t* job = context;
+  int ret = fallocate(job->fd, job->mode, job->offset, job->len);
+  return ret < 0 ? -errno : 0;
+}
+
+static long run_ftruncate(void* context) {
+  fallocate_job_t* job = context;
+  return ftruncate(job->fd, job->len) < 0 ? -errno : 0;
+}
+
+static int epoll_fallocate(int fd, int mode, off_t offset, off_t len) {
+  fallocate_job_t job = {fd, mode, offset, len};
+  return epoll_offload(run_fallocate, &job);
+}
+
+static int epoll_ftruncate(int fd, off_t length) {
+  fallocate_job_t job = {fd, 0, 0, length};
+  return epoll_offload(run_ftruncate, &job);
+}
+
+typedef struct {
+  int olddirfd;
+  const char* oldpath;
+  int newdirfd;
+  const char* newpath;
+  unsigned flags;
+  mode_t mode;
+} path_job_t;
+
+static long run_unlinkat(void* context) {
+  path_job_t* job = context;
+  int ret = unlinkat(job->olddirfd, job->oldpath, job->flags);
+  return ret < 0 ? -errno : 0;
+}
+
+static long run_renameat(void* context) {
+  path_job_t* job = context;
+  int ret = renameat2(job->olddirfd, job->oldpath, job->newdirfd,
+                      job->newpath, job->flags);
+  return ret < 0 ? -errno : 0;
+}
+
+static long run_mkdirat(void* context) {
+  path_job_t* job = context;
+  int ret = mkdirat(job->olddirfd, job->oldpath, job->mode);
+  return ret < 0 ? -errno : 0;
+}
+
+static int epoll_unlinkat(int dirfd, const char* pathname, int flags) {
+  path_job_t job = {dirfd, pathname, -1, NULL, flags, 0};
+  return epoll_offload(run_unlinkat, &job);
+}
+
+static int epoll_renameat(int olddirfd, const char* oldpath, int newdirfd,
+                          const char* newpath, unsigned flags) {
+  path_job_t job = {olddirfd, oldpath, newdirfd, newpath, flags, 0};
+  return epoll_offload(run_renameat, &job);
+}
+
+static int epoll_mkdirat(int dirfd, const char* pathname, mode_t mode) {
+  path_job_t job = {dirfd, pathname, -1, NULL, 0, mode};
+  return epoll_offload(run_mkdirat, &job);
+}
+
+typedef struct {
+  int fd;
+  void* addr;
+  off_t offset;
+  off_t len;
+  int advice;
+} advise_job_t;
+
+static long run_fadvise(void* context) {
+  advise_job_t* job = context;
+  // Returns the error number instead of setting errno.
+  return -posix_fadvise(job->fd, job->offset, job->len, job->advice);
+}
+
+static long run_madvise(void* context) {
+  advise_job_t* job = context;
+  int ret = madvise(job->addr, job->len, job->advice);
+  return ret < 0 ? -errno : 0;
+}
+
+static int epoll_fadvise(int fd, off_t offset, off_t len, int advice) {
+  advise_job_t job = {fd, NULL, offset, len, advice};
+  return epoll_offload(run_fadvise, &job);
+}
+
+static int epoll_madvise(void* addr, size_t len, int advice) {
+  advise_job_t job = {-1, addr, 0, len, advice};
+  return epoll_offload(run_madvise, &job);
+}
+
+static int epoll_prefetch(int fd, off_t offset, off_t len) {
+  // The kernel only queues the reads, so this runs in place.
+  return -posix_fadvise(fd, offset, len, POSIX_FADV_WILLNEED);
+}
+
+static int epoll_close(int fd) {
+  // Requests still waiting for the file descriptor would never be woken.
+  complete_fd(get_epoll_engine(), fd, -EBADF);
+  return close(fd) < 0 ? -errno : 0;
+}
+
+static int epoll_sleep(uint64_t duration_ns) {
+  rocket_fiber_t* fiber = get_current_fiber();
+  epoll_engine_t* engine = get_epoll_engine();
+  if (rocket_fiber_take_cancel(fiber)) {
+    return -ECANCELED;
+  }
+
+  epoll_request_t request;
+  init_request(&request, fiber);
+  add_timer(engine, &request, now_ns() + duration_ns, /*timeout_result=*/0);
+  bool canceled;
+  if (rocket_future_await_request(&request.future, &request.future,
+                                  &canceled) < 0) {
+    perror("rocket_future_await");
+    return -1;
+  }
+  return request.future.result;
+}
+
+static int epoll_cancel_fd(int fd) {
+  return complete_fd(get_epoll_engine(), fd, -ECANCELED);
+}
+
+static const rocket_engine_ops_t epoll_engine_ops = {
+    .destroy = epoll_destroy,
+    .await_completions = epoll_await_completions,
+    .cancel = epoll_cancel,
+    .openat = epoll_openat,
+    .readat = epoll_readat,
+    .writeat = epoll_writeat,
+    .close = epoll_close,
+    .readv = epoll_readv,
+    .writev = epoll_writev,
+    .accept = epoll_accept,
+    .socket = epoll_socket,
+    .connect = epoll_connect,
+    .shutdown = epoll_shutdown,
+    .send = epoll_send,
+    .recv = epoll_recv,
+    .sendmsg = epoll_sendmsg,
+    .recvmsg = epoll_recvmsg,
+    .sleep = epoll_sleep,
+    .cancel_fd = epoll_cancel_fd,
+    .fsync = epoll_fsync,
+    .sync_file_range = epoll_sync_file_range,
+    .statx = epoll_statx,
+    .fallocate = epoll_fallocate,
+    .ftruncate = epoll_ftruncate,
+    .unlinkat = epoll_unlinkat,
+    .renameat = epoll_renameat,
+    .mkdirat = epoll_mkdirat,
+    .fadvise = epoll_fadvise,
+    .madvise = epoll_madvise,
+    .prefetch = epoll_prefetch,
+    .offload = epoll_offload,
+};
@@ -23,15 +23,26 @@
  * SOFTWARE.
  */
 
+// For pipe2 and splice flags.
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <limits.h>
 #include <liburing.h>
-#include <stdarg.h>
+#include <poll.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <rocket/rocket_engine.h>
 #include <rocket/rocket_fiber.h>
 
+#include "busy_poll.h"
+#include "rocket_engine.h"
 #include "rocket_executor.h"
 #include "rocket_future.h"
+#include "rocket_offload.h"
 #include "switch.h"
 
 typedef struct {
@@ -39,57 +50,870 @@ typedef struct {
   const char* pathname;
   int oflag;
   int pmode;
+  // Fixed file slot to open the file into. Only used by openat_direct_await.
+  unsigned file_index;
 } openat_context_t;
 
+// Buffers registered with the kernel, carved out of one region.
+typedef struct {
+  void* region;
+  size_t buffer_size;
+  unsigned nr_buffers;
+  // Stack of the indices of buffers not handed out.
+  int* free_indices;
+  unsigned nr_free;
+} registered_buffers_t;
+
 // The io_uring implementation of rocket engine.
-struct rocket_engine {
+typedef struct {
+  rocket_engine_t base;
   struct io_uring uring;
-};
+  registered_buffers_t buffers;
+  // Requests completed without parking the fiber since the executor last
+  // waited for completions.
+  unsigned inline_completions;
+
+  busy_poll_t busy_poll;
+
+  // Threads running rocket_offload_await calls, created on first use.
+  rocket_offload_pool_t* offload;
+  // Number of offloaded calls not reaped yet.
+  unsigned offload_running;
+  // Poll of the eventfd of the pool, armed while calls are running.
+  rocket_future_t offload_poll;
+  bool offload_polling;
+  // Calls reaped but whose fibers are not handed to the executor yet.
+  dlist_node_t offload_done;
+
+  // Fibers waiting for room in the submission queue, in arrival order.
+  dlist_node_t sq_waiters;
+
+  // Whether the kernel supports ftruncate requests (Linux 6.9).
+  bool has_ftruncate;
+  // Shared by all readahead requests of rocket_prefetch, which nobody waits
+  // for.
+  rocket_future_t prefetch_request;
+} uring_engine_t;
+
+// Fiber waiting for room in the submission queue.
+typedef struct {
+  rocket_future_t future;
+  dlist_node_t node;
+  unsigned nr_sqes;
+} sq_waiter_t;
+
+// Maximum number of requests completed without parking the fiber in a row,
+// so that fibers always finding their requests ready don't starve others.
+#define FAST_PATH_BUDGET 64
 
 typedef void (*io_uring_prepare_t)(struct io_uring_sqe* sqe, void* context);
 
-rocket_engine_t* rocket_engine_create(size_t queue_depth) {
-  rocket_engine_t* engine = malloc(sizeof(rocket_engine_t));
+// Returns NULL if engine is not an io_uring engine.
+static uring_engine_t* to_uring_engine(rocket_engine_t* engine) {
+  if (engine->config.backend != ROCKET_ENGINE_IO_URING) {
+    return NULL;
+  }
+  return container_of(engine, uring_engine_t, base);
+}
+
+// Returns the engine of the current fiber, or NULL if it is not an io_uring
+// engine, in which case io_uring specific requests fail with -EOPNOTSUPP.
+static uring_engine_t* get_uring_engine(void) {
+  return to_uring_engine(
+      rocket_executor_get_engine(get_current_fiber()->executor));
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Hint to the CPU that this is a busy-wait loop.
+static inline void cpu_relax(void) {
+#if defined(__x86_64__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+static unsigned get_setup_flags(const rocket_engine_config_t* config) {
+  unsigned flags = 0;
+  if (config->cq_entries > 0) {
+    flags |= IORING_SETUP_CQSIZE;
+  }
+  if (config->flags & ROCKET_ENGINE_SINGLE_ISSUER) {
+    flags |= IORING_SETUP_SINGLE_ISSUER;
+  }
+  if (config->flags & ROCKET_ENGINE_DEFER_TASKRUN) {
+    flags |= IORING_SETUP_DEFER_TASKRUN;
+  }
+  if (config->flags & ROCKET_ENGINE_COOP_TASKRUN) {
+    flags |= IORING_SETUP_COOP_TASKRUN;
+  }
+  if (config->flags & ROCKET_ENGINE_IOPOLL) {
+    flags |= IORING_SETUP_IOPOLL;
+  }
+  if (config->flags & ROCKET_ENGINE_SQPOLL) {
+    flags |= IORING_SETUP_SQPOLL;
+    if (config->sq_thread_cpu >= 0) {
+      flags |= IORING_SETUP_SQ_AFF;
+    }
+  }
+  if (config->attach_engine != NULL) {
+    flags |= IORING_SETUP_ATTACH_WQ;
+  }
+  return flags;
+}
+
+static int setup_uring(struct io_uring* uring,
+                       const rocket_engine_config_t* config,
+                       unsigned* features) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  params.flags = get_setup_flags(config);
+  params.cq_entries = config->cq_entries;
+  params.sq_thread_idle = config->sq_thread_idle_ms;
+  if (config->sq_thread_cpu >= 0) {
+    params.sq_thread_cpu = config->sq_thread_cpu;
+  }
+  if (config->attach_engine != NULL) {
+    uring_engine_t* attach_engine = to_uring_engine(config->attach_engine);
+    if (attach_engine == NULL) {
+      return -EINVAL;
+    }
+    params.wq_fd = attach_engine->uring.ring_fd;
+  }
+
+  int ret = io_uring_queue_init_params(config->queue_depth, uring, &params);
+  *features = params.features;
+  return ret;
+}
+
+// Flags that are dropped when the kernel doesn't know them.
+#define OPTIONAL_FLAGS                                    \
+  (ROCKET_ENGINE_DEFER_TASKRUN | ROCKET_ENGINE_SINGLE_ISSUER | \
+   ROCKET_ENGINE_COOP_TASKRUN)
+
+// Whether the kernel accepts config without its optional flags, i.e. whether
+// it rejected the flags rather than the rest of the configuration.
+static bool accepts_base_config(const rocket_engine_config_t* config) {
+  rocket_engine_config_t base = *config;
+  base.flags &= ~OPTIONAL_FLAGS;
+  struct io_uring uring;
+  unsigned features;
+  if (setup_uring(&uring, &base, &features) < 0) {
+    return false;
+  }
+  io_uring_queue_exit(&uring);
+  return true;
+}
+
+// Clear the flags of config whose setup flags the ring doesn't have.
+static void record_setup_flags(rocket_engine_config_t* config,
+                               unsigned setup_flags) {
+  static const struct {
+    unsigned flag;
+    unsigned setup_flag;
+  } flag_map[] = {
+      {ROCKET_ENGINE_SINGLE_ISSUER, IORING_SETUP_SINGLE_ISSUER},
+      {ROCKET_ENGINE_DEFER_TASKRUN, IORING_SETUP_DEFER_TASKRUN},
+      {ROCKET_ENGINE_COOP_TASKRUN, IORING_SETUP_COOP_TASKRUN},
+      {ROCKET_ENGINE_IOPOLL, IORING_SETUP_IOPOLL},
+      {ROCKET_ENGINE_SQPOLL, IORING_SETUP_SQPOLL},
+  };
+  for (size_t i = 0; i < sizeof(flag_map) / sizeof(flag_map[0]); i++) {
+    if (!(setup_flags & flag_map[i].setup_flag)) {
+      config->flags &= ~flag_map[i].flag;
+    }
+  }
+}
+
+// Initialize the ring with the setup flags in config. Kernels reject setup
+// flags they don't know about with EINVAL, in which case the most recently
+// added flag is dropped from config and the setup is retried, as long as the
+// kernel accepts the configuration without those flags. Submission queue
+// polling is dropped if the kernel doesn't allow it for this user. On
+// success, config has the flags the ring was set up with.
+static int init_uring(struct io_uring* uring, rocket_engine_config_t* config) {
+  if (config->flags & ROCKET_ENGINE_SQPOLL) {
+    // Deferred task running requires the submitting thread to run completion
+    // work, but the polling thread is the one submitting.
+    config->flags &= ~ROCKET_ENGINE_DEFER_TASKRUN;
+  }
+  if (config->flags & ROCKET_ENGINE_DEFER_TASKRUN) {
+    config->flags |= ROCKET_ENGINE_SINGLE_ISSUER;
+  }
+
+  bool base_config_checked = false;
+  while (true) {
+    unsigned features;
+    int ret = setup_uring(uring, config, &features);
+    if (ret == 0) {
+      if ((config->flags & ROCKET_ENGINE_REQUIRE_NODROP) &&
+          !(features & IORING_FEAT_NODROP)) {
+        io_uring_queue_exit(uring);
+        return -ENOTSUP;
+      }
+      record_setup_flags(config, uring->flags);
+      return 0;
+    }
+    if (ret == -EPERM && (config->flags & ROCKET_ENGINE_SQPOLL)) {
+      // Linux 5.11 lifted the privilege requirement.
+      config->flags &= ~ROCKET_ENGINE_SQPOLL;
+      continue;
+    }
+    if (ret != -EINVAL || !(config->flags & OPTIONAL_FLAGS)) {
+      return ret;
+    }
+    if (!base_config_checked) {
+      // Something else than the flags is invalid, e.g. cq_entries or
+      // attach_engine. Leave the flags alone.
+      if (!accepts_base_config(config)) {
+        return ret;
+      }
+      base_config_checked = true;
+    }
+
+    if (config->flags & ROCKET_ENGINE_DEFER_TASKRUN) {
+      // Linux 6.1
+      config->flags &= ~ROCKET_ENGINE_DEFER_TASKRUN;
+    } else if (config->flags & ROCKET_ENGINE_SINGLE_ISSUER) {
+      // Linux 6.0
+      config->flags &= ~ROCKET_ENGINE_SINGLE_ISSUER;
+    } else {
+      // Linux 5.19
+      config->flags &= ~ROCKET_ENGINE_COOP_TASKRUN;
+    }
+  }
+}
+
+// Let the kernel busy-poll the network devices of the sockets requests wait
+// on. It tracks them on its own as requests wait on sockets. Dropped from
+// config if the kernel doesn't support it (Linux 6.9).
+static void register_napi(struct io_uring* uring,
+                          rocket_engine_config_t* config) {
+  if (config->napi_busy_poll_us == 0) {
+    config->flags &= ~ROCKET_ENGINE_NAPI_PREFER_BUSY_POLL;
+    return;
+  }
+
+  struct io_uring_napi napi;
+  memset(&napi, 0, sizeof(napi));
+  napi.busy_poll_to = config->napi_busy_poll_us;
+  napi.prefer_busy_poll =
+      (config->flags & ROCKET_ENGINE_NAPI_PREFER_BUSY_POLL) != 0;
+  if (io_uring_register_napi(uring, &napi) < 0) {
+    config->napi_busy_poll_us = 0;
+    config->flags &= ~ROCKET_ENGINE_NAPI_PREFER_BUSY_POLL;
+  }
+}
+
+static const rocket_engine_ops_t uring_engine_ops;
+static rocket_future_t* prefetch_on_complete(rocket_future_t* request,
+                                             int result, uint32_t flags);
+
+rocket_engine_t* rocket_engine_uring_create(
+    const rocket_engine_config_t* config) {
+  uring_engine_t* engine = malloc(sizeof(uring_engine_t));
   if (engine == NULL) {
     return NULL;
   }
 
-  if (io_uring_queue_init(queue_depth, &engine->uring, 0) < 0) {
-    perror("io_uring_queue_init");
+  engine->base.ops = &uring_engine_ops;
+  engine->base.config = *config;
+  engine->base.detached_requests = 0;
+  memset(&engine->base.stats, 0, sizeof(engine->base.stats));
+  memset(&engine->buffers, 0, sizeof(engine->buffers));
+  engine->inline_completions = 0;
+  busy_poll_init(&engine->busy_poll, config->busy_poll_us);
+  engine->base.stats.busy_poll_window_ns = engine->busy_poll.window_ns;
+  engine->offload = NULL;
+  engine->offload_running = 0;
+  engine->offload_polling = false;
+  dlist_init(&engine->offload_done);
+  dlist_init(&engine->sq_waiters);
+  int ret = init_uring(&engine->uring, &engine->base.config);
+  if (ret < 0) {
+    fprintf(stderr, "io_uring_queue_init_params: %s\n", strerror(-ret));
     free(engine);
     return NULL;
   }
+  register_napi(&engine->uring, &engine->base.config);
+  engine->has_ftruncate = false;
+  memset(&engine->prefetch_request, 0, sizeof(engine->prefetch_request));
+  engine->prefetch_request.on_complete = prefetch_on_complete;
+  struct io_uring_probe* probe = io_uring_get_probe_ring(&engine->uring);
+  if (probe != NULL) {
+    engine->has_ftruncate =
+        io_uring_opcode_supported(probe, IORING_OP_FTRUNCATE);
+    io_uring_free_probe(probe);
+  }
 
-  return engine;
+  return &engine->base;
 }
 
-void rocket_engine_destroy(rocket_engine_t* engine) {
+static void uring_destroy(rocket_engine_t* base) {
+  uring_engine_t* engine = to_uring_engine(base);
   io_uring_queue_exit(&engine->uring);
+  if (engine->offload != NULL) {
+    rocket_offload_pool_destroy(engine->offload);
+  }
+  free(engine->buffers.region);
+  free(engine->buffers.free_indices);
   free(engine);
 }
 
-rocket_future_t* rocket_engine_await_next(rocket_engine_t* engine) {
-  struct io_uring_cqe* cqe = NULL;
-  if (io_uring_wait_cqe(&engine->uring, &cqe) < 0) {
-    perror("io_uring_wait_cqe");
+int rocket_engine_register_files(rocket_engine_t* base, unsigned nr_files) {
+  uring_engine_t* engine = to_uring_engine(base);
+  if (engine == NULL) {
+    return -EOPNOTSUPP;
+  }
+  return io_uring_register_files_sparse(&engine->uring, nr_files);
+}
+
+int rocket_engine_update_file(rocket_engine_t* base, unsigned file_index,
+                              int fd) {
+  uring_engine_t* engine = to_uring_engine(base);
+  if (engine == NULL) {
+    return -EOPNOTSUPP;
+  }
+  int ret = io_uring_register_files_update(&engine->uring, file_index, &fd, 1);
+  return ret < 0 ? ret : 0;
+}
+
+int rocket_engine_unregister_files(rocket_engine_t* base) {
+  uring_engine_t* engine = to_uring_engine(base);
+  if (engine == NULL) {
+    return -EOPNOTSUPP;
+  }
+  return io_uring_unregister_files(&engine->uring);
+}
+
+// Whether the sizes of nr_buffers buffers of buffer_size bytes, and of
+// their iovecs, don't wrap around.
+static bool buffer_sizes_fit(unsigned nr_buffers, size_t buffer_size) {
+  size_t size;
+  return !__builtin_mul_overflow(nr_buffers, buffer_size, &size) &&
+         !__builtin_mul_overflow(nr_buffers, sizeof(struct iovec), &size);
+}
+
+int rocket_engine_register_buffers(rocket_engine_t* base,
+                                   unsigned nr_buffers, size_t buffer_size) {
+  uring_engine_t* engine = to_uring_engine(base);
+  if (engine == NULL) {
+    return -EOPNOTSUPP;
+  }
+  registered_buffers_t* buffers = &engine->buffers;
+  if (buffers->region != NULL) {
+    return -EBUSY;
+  }
+  if (!buffer_sizes_fit(nr_buffers, buffer_size)) {
+    return -EINVAL;
+  }
+
+  void* region = NULL;
+  if (posix_memalign(&region, getpagesize(), nr_buffers * buffer_size) != 0) {
+    return -ENOMEM;
+  }
+  int* free_indices = malloc(nr_buffers * sizeof(int));
+  struct iovec* iovecs = malloc(nr_buffers * sizeof(struct iovec));
+  if (free_indices == NULL || iovecs == NULL) {
+    free(region);
+    free(free_indices);
+    free(iovecs);
+    return -ENOMEM;
+  }
+
+  for (unsigned i = 0; i < nr_buffers; i++) {
+    iovecs[i].iov_base = (char*)region + i * buffer_size;
+    iovecs[i].iov_len = buffer_size;
+    // Hand out lower indices first.
+    free_indices[i] = nr_buffers - 1 - i;
+  }
+  int ret = io_uring_register_buffers(&engine->uring, iovecs, nr_buffers);
+  free(iovecs);
+  if (ret < 0) {
+    free(region);
+    free(free_indices);
+    return ret;
+  }
+
+  buffers->region = region;
+  buffers->buffer_size = buffer_size;
+  buffers->nr_buffers = nr_buffers;
+  buffers->free_indices = free_indices;
+  buffers->nr_free = nr_buffers;
+  return 0;
+}
+
+int rocket_engine_unregister_buffers(rocket_engine_t* base) {
+  uring_engine_t* engine = to_uring_engine(base);
+  if (engine == NULL) {
+    return -EOPNOTSUPP;
+  }
+  registered_buffers_t* buffers = &engine->buffers;
+  if (buffers->region == NULL) {
+    return -ENXIO;
+  }
+
+  int ret = io_uring_unregister_buffers(&engine->uring);
+  if (ret < 0) {
+    return ret;
+  }
+  free(buffers->region);
+  free(buffers->free_indices);
+  memset(buffers, 0, sizeof(*buffers));
+  return 0;
+}
+
+void* rocket_engine_alloc_buffer(rocket_engine_t* base, int* buf_index) {
+  uring_engine_t* engine = to_uring_engine(base);
+  if (engine == NULL) {
+    return NULL;
+  }
+  registered_buffers_t* buffers = &engine->buffers;
+  if (buffers->nr_free == 0) {
     return NULL;
   }
 
-  // Complete the future object associated with the request.
-  rocket_future_t* future = io_uring_cqe_get_data(cqe);
+  *buf_index = buffers->free_indices[--buffers->nr_free];
+  return (char*)buffers->region + *buf_index * buffers->buffer_size;
+}
+
+void rocket_engine_free_buffer(rocket_engine_t* base, int buf_index) {
+  uring_engine_t* engine = to_uring_engine(base);
+  if (engine == NULL) {
+    return;
+  }
+  registered_buffers_t* buffers = &engine->buffers;
+  assert(buf_index >= 0 && (unsigned)buf_index < buffers->nr_buffers);
+  assert(buffers->nr_free < buffers->nr_buffers);
+  buffers->free_indices[buffers->nr_free++] = buf_index;
+}
+
+static int uring_submit(uring_engine_t* engine) {
+  if (io_uring_sq_ready(&engine->uring) == 0) {
+    return 0;
+  }
+
+  int ret = io_uring_submit(&engine->uring);
+  if (ret == -EBUSY) {
+    // The kernel holds completions that overflowed the completion queue and
+    // refuses new requests until the executor reaps some of them.
+    return 0;
+  }
+  if (ret < 0) {
+    fprintf(stderr, "io_uring_submit: %s\n", strerror(-ret));
+    return ret;
+  }
+
+  return ret;
+}
+
+typedef struct {
+  rocket_future_t future;
+  rocket_offload_job_t job;
+} offload_request_t;
+
+// Keep a poll of the eventfd of the offload pool in flight while calls are
+// running, so that the executor wakes up when they return.
+static int arm_offload_poll(uring_engine_t* engine) {
+  if (engine->offload_polling || engine->offload_running == 0) {
+    return 0;
+  }
+  struct io_uring_sqe* sqe = io_uring_get_sqe(&engine->uring);
+  if (sqe == NULL) {
+    // Flush the requests queued up by other fibers to make room.
+    if (uring_submit(engine) < 0) {
+      return -1;
+    }
+    sqe = io_uring_get_sqe(&engine->uring);
+  }
+  if (sqe == NULL) {
+    // The executor tries again before waiting for completions.
+    return -EBUSY;
+  }
+  io_uring_prep_poll_add(sqe, rocket_offload_pool_eventfd(engine->offload),
+                         POLLIN);
+  io_uring_sqe_set_data(sqe, &engine->offload_poll);
+  engine->offload_polling = true;
+  return 0;
+}
+
+static rocket_future_t* offload_poll_on_complete(rocket_future_t* request,
+                                                 int result, uint32_t flags) {
+  uring_engine_t* engine =
+      container_of(request, uring_engine_t, offload_poll);
+  engine->offload_polling = false;
+  engine->offload_running -=
+      rocket_offload_pool_reap(engine->offload, &engine->offload_done);
+  // The fibers of the reaped calls are handed to the executor separately.
+  return NULL;
+}
+
+// Complete the futures of up to max_futures reaped offloaded calls and store
+// them in futures. Returns their number.
+static size_t complete_offloaded(uring_engine_t* engine,
+                                 rocket_future_t** futures,
+                                 size_t max_futures) {
+  size_t count = 0;
+  while (count < max_futures && !dlist_is_empty(&engine->offload_done)) {
+    rocket_offload_job_t* job = container_of(
+        dlist_pop_head(&engine->offload_done), rocket_offload_job_t,
+        list_node);
+    offload_request_t* request = container_of(job, offload_request_t, job);
+    request->future.completed = true;
+    request->future.error = 0;
+    request->future.result = job->result;
+    futures[count++] = &request->future;
+  }
+  return count;
+}
+
+// Complete the futures of the fibers waiting for room in the submission
+// queue, in order, as long as there is enough room for them. Stores up to
+// max_futures of them in futures. Returns their number.
+static size_t wake_sq_waiters(uring_engine_t* engine,
+                              rocket_future_t** futures, size_t max_futures) {
+  unsigned space = io_uring_sq_space_left(&engine->uring);
+  size_t count = 0;
+  while (count < max_futures && !dlist_is_empty(&engine->sq_waiters)) {
+    sq_waiter_t* waiter =
+        container_of(engine->sq_waiters.next, sq_waiter_t, node);
+    if (waiter->nr_sqes > space) {
+      break;
+    }
+    space -= waiter->nr_sqes;
+    dlist_remove_node(&waiter->node);
+    waiter->future.completed = true;
+    waiter->future.error = 0;
+    waiter->future.result = 0;
+    futures[count++] = &waiter->future;
+  }
+  return count;
+}
+
+// Submit queued requests and spin on the completion queue for the busy-poll
+// window. Returns true if completions arrived in the meantime.
+static bool spin_completions(uring_engine_t* engine) {
+  if (engine->busy_poll.window_ns == 0 || uring_submit(engine) < 0) {
+    return false;
+  }
+  // Deferred completion work only runs, and polled requests are only polled,
+  // when the thread enters the kernel.
+  bool get_events = engine->base.config.flags &
+                    (ROCKET_ENGINE_DEFER_TASKRUN | ROCKET_ENGINE_IOPOLL);
+  uint64_t deadline_ns = now_ns() + engine->busy_poll.window_ns;
+  do {
+    if (get_events) {
+      io_uring_get_events(&engine->uring);
+    }
+    if (io_uring_cq_ready(&engine->uring) > 0) {
+      engine->base.stats.busy_poll_hits++;
+      return true;
+    }
+    cpu_relax();
+  } while (now_ns() < deadline_ns);
+  return false;
+}
+
+static int uring_await_completions(rocket_engine_t* base,
+                                   rocket_future_t** futures,
+                                   size_t max_futures) {
+  uring_engine_t* engine = to_uring_engine(base);
+  engine->inline_completions = 0;
+  arm_offload_poll(engine);
+  // Submit queued requests and wait for completions with one syscall. Skip it
+  // if there is nothing to submit and completions are already available.
+  // Offloaded calls already reaped count as available completions, and so
+  // does the room the submission frees for fibers waiting for it.
+  unsigned wait_nr = dlist_is_empty(&engine->offload_done) &&
+                             dlist_is_empty(&engine->sq_waiters)
+                         ? 1
+                         : 0;
+  // Busy-poll for a while before going to sleep in the kernel, which saves
+  // the wakeup latency if completions arrive soon.
+  uint64_t wait_start_ns = 0;
+  if (engine->base.config.busy_poll_us > 0 && wait_nr > 0 &&
+      io_uring_cq_ready(&engine->uring) == 0) {
+    wait_start_ns = now_ns();
+    if (spin_completions(engine)) {
+      wait_nr = 0;
+    }
+  }
+  if (io_uring_sq_ready(&engine->uring) > 0 ||
+      (io_uring_cq_ready(&engine->uring) == 0 && wait_nr > 0)) {
+    int ret;
+    do {
+      ret = io_uring_submit_and_wait(&engine->uring, wait_nr);
+    } while (ret == -EINTR);
+    // On EBUSY, completions overflowed the completion queue. Reap them first
+    // and submit on the next round.
+    if (ret < 0 && !(ret == -EBUSY && io_uring_cq_ready(&engine->uring) > 0)) {
+      perror("io_uring_submit_and_wait");
+      return -1;
+    }
+  }
+  if (wait_start_ns > 0) {
+    busy_poll_update(&engine->busy_poll, now_ns() - wait_start_ns);
+    engine->base.stats.busy_poll_window_ns = engine->busy_poll.window_ns;
+  }
+
+  // Complete the future objects associated with all available completions,
+  // then release the completions back to the kernel at once.
+  size_t count = 0;
+  unsigned seen = 0;
+  unsigned head;
+  struct io_uring_cqe* cqe;
+  io_uring_for_each_cqe(&engine->uring, head, cqe) {
+    if (count == max_futures) {
+      break;
+    }
+    seen++;
+
+    // Requests nobody waits for have no future.
+    rocket_future_t* future = io_uring_cqe_get_data(cqe);
+    if (future == NULL) {
+      continue;
+    }
+
+    if (future->on_complete != NULL) {
+      future = future->on_complete(future, cqe->res, cqe->flags);
+      if (future == NULL) {
+        continue;
+      }
+    } else {
+      future->completed = true;
+      future->error = 0;
+      future->result = cqe->res;
+      future->flags = cqe->flags;
+    }
+    futures[count++] = future;
+  }
+  io_uring_cq_advance(&engine->uring, seen);
+
+  count += complete_offloaded(engine, futures + count, max_futures - count);
+  count += wake_sq_waiters(engine, futures + count, max_futures - count);
+  return count;
+}
+
+static bool should_submit_now(uring_engine_t* engine) {
+  if (engine->base.config.flags & ROCKET_ENGINE_SQPOLL) {
+    return true;
+  }
+  return engine->base.config.submit_batch_size > 0 &&
+         io_uring_sq_ready(&engine->uring) >= engine->base.config.submit_batch_size;
+}
+
+// Park the current fiber until the executor finds room for nr_sqes entries
+// in the submission queue.
+static int wait_sq_space(uring_engine_t* engine, unsigned nr_sqes) {
+  sq_waiter_t waiter;
+  memset(&waiter, 0, sizeof(waiter));
+  waiter.future.fiber = get_current_fiber();
+  waiter.future.error = -1;
+  waiter.future.result = -1;
+  waiter.nr_sqes = nr_sqes;
+  dlist_push_tail(&engine->sq_waiters, &waiter.node);
+  engine->base.stats.sq_waits++;
+  return rocket_future_await(&waiter.future);
+}
+
+// Whether flushing the submission queue makes room for more requests.
+// Completions that overflowed the completion queue are buffered by the
+// kernel, and submitting more requests only adds to them, so fibers wait for
+// the executor to reap them first.
+static bool may_flush(uring_engine_t* engine) {
+  return !io_uring_cq_has_overflow(&engine->uring);
+}
+
+// Get a free SQE. If the submission queue is full, flush it, or wait until
+// the executor makes room.
+static struct io_uring_sqe* get_sqe(uring_engine_t* engine) {
+  while (true) {
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&engine->uring);
+    if (sqe != NULL) {
+      return sqe;
+    }
+    // The submission queue is full of requests queued up by other fibers.
+    // Flush them to make room for this one.
+    if (may_flush(engine)) {
+      if (uring_submit(engine) < 0) {
+        return NULL;
+      }
+      sqe = io_uring_get_sqe(&engine->uring);
+      if (sqe != NULL) {
+        return sqe;
+      }
+    }
+
+    if (engine->base.config.flags & ROCKET_ENGINE_SQPOLL) {
+      // Submitted entries are only freed once the polling thread picks them
+      // up.
+      io_uring_sqring_wait(&engine->uring);
+    } else if (wait_sq_space(engine, 1) < 0) {
+      // Completions overflowed, or the kernel refused the queued requests
+      // until they are reaped, which the executor does before handing out
+      // room again.
+      return NULL;
+    }
+  }
+}
+
+// Get a free SQE without ever parking the current fiber, flushing the
+// submission queue once if it's full. Returns NULL if there's still no room.
+static struct io_uring_sqe* get_sqe_nowait(uring_engine_t* engine) {
+  struct io_uring_sqe* sqe = io_uring_get_sqe(&engine->uring);
+  if (sqe == NULL && uring_submit(engine) >= 0) {
+    sqe = io_uring_get_sqe(&engine->uring);
+  }
+  return sqe;
+}
+
+// Make room in the submission queue for nr_sqes entries, so that requests
+// linked together are submitted at once.
+static int reserve_sqes(uring_engine_t* engine, unsigned nr_sqes) {
+  if (nr_sqes > engine->uring.sq.ring_entries) {
+    return -EINVAL;
+  }
+  if (io_uring_sq_space_left(&engine->uring) < nr_sqes && may_flush(engine) &&
+      uring_submit(engine) < 0) {
+    return -1;
+  }
+  while (io_uring_sq_space_left(&engine->uring) < nr_sqes) {
+    int ret;
+    if (engine->base.config.flags & ROCKET_ENGINE_SQPOLL) {
+      ret = io_uring_sqring_wait(&engine->uring);
+    } else {
+      // Completions overflowed, or the kernel refused the queued requests
+      // until they are reaped.
+      ret = wait_sq_space(engine, nr_sqes);
+    }
+    if (ret < 0) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+// Whether the current request may complete without parking the fiber. See
+// ROCKET_ENGINE_FAST_PATH.
+static bool fast_path_allowed(uring_engine_t* engine) {
+  return (engine->base.config.flags & ROCKET_ENGINE_FAST_PATH) &&
+         engine->inline_completions < FAST_PATH_BUDGET &&
+         !get_current_fiber()->cancel_pending;
+}
+
+// Take the completion of future if the kernel completed it during
+// submission, i.e. it's at the head of the completion queue.
+static void peek_completion(uring_engine_t* engine, rocket_future_t* future) {
+  struct io_uring_cqe* cqe;
+  if (io_uring_peek_cqe(&engine->uring, &cqe) < 0 ||
+      io_uring_cqe_get_data(cqe) != future) {
+    return;
+  }
   future->completed = true;
   future->error = 0;
   future->result = cqe->res;
+  future->flags = cqe->flags;
   io_uring_cqe_seen(&engine->uring, cqe);
+  engine->inline_completions++;
+}
 
-  return future;
+// Result of a non-blocking syscall tried instead of submitting a request:
+// ret, -errno if it failed, or -EAGAIN if the request has to go through the
+// ring.
+static ssize_t inline_result(uring_engine_t* engine, ssize_t ret) {
+  if (ret < 0) {
+    if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+      return -EAGAIN;
+    }
+    ret = -errno;
+  }
+  engine->inline_completions++;
+  engine->base.stats.fast_path_syscalls++;
+  return ret;
 }
 
-static int io_uring_submit_await(
+static int uring_cancel(rocket_engine_t* base, rocket_future_t* request) {
+  uring_engine_t* engine = to_uring_engine(base);
+  // Canceling doesn't block. Without room, the request runs to completion
+  // and the fiber's pending cancellation fails its next request instead.
+  struct io_uring_sqe* sqe = get_sqe_nowait(engine);
+  if (sqe == NULL) {
+    return -EBUSY;
+  }
+  io_uring_prep_cancel(sqe, request, /*flags=*/0);
+  // The canceled request completes on its own.
+  io_uring_sqe_set_data(sqe, NULL);
+  if (should_submit_now(engine) && uring_submit(engine) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+// Completion of the timeout linked to a request, which comes on its own,
+// before or after the request's: -ETIME if it fired. Only wakes the fiber if
+// it already waits for it, see await_link_timeout.
+static rocket_future_t* link_timeout_on_complete(rocket_future_t* timeout,
+                                                 int result, uint32_t flags) {
+  timeout->completed = true;
+  timeout->error = 0;
+  timeout->result = result;
+  timeout->flags = flags;
+  return dlist_node_in_list(&timeout->list_node) ? timeout : NULL;
+}
+
+// Queue a timeout of timeout_ns linked to sqe, the last queued entry, which
+// completes timeout. ts must stay valid until the submission.
+static void prep_link_timeout(uring_engine_t* engine, struct io_uring_sqe* sqe,
+                              struct __kernel_timespec* ts, uint64_t timeout_ns,
+                              rocket_future_t* timeout) {
+  memset(timeout, 0, sizeof(*timeout));
+  timeout->error = -1;
+  timeout->result = -1;
+  timeout->on_complete = link_timeout_on_complete;
+  io_uring_sqe_set_flags(sqe, sqe->flags | IOSQE_IO_LINK);
+  ts->tv_sec = timeout_ns / 1000000000;
+  ts->tv_nsec = timeout_ns % 1000000000;
+  struct io_uring_sqe* timeout_sqe = io_uring_get_sqe(&engine->uring);
+  io_uring_prep_link_timeout(timeout_sqe, ts, /*flags=*/0);
+  io_uring_sqe_set_data(timeout_sqe, timeout);
+}
+
+// Wait for the timeout linked to a completed request, as it points at the
+// stack of the fiber, and return the result of the request: -ETIME if the
+// timeout canceled it, as opposed to another cancellation.
+static int await_link_timeout(rocket_future_t* timeout, int result) {
+  if (rocket_future_await(timeout) < 0) {
+    perror("rocket_future_await");
+    return -1;
+  }
+  if (result == -ECANCELED && timeout->result == -ETIME) {
+    return -ETIME;
+  }
+  return result;
+}
+
+// Submit a request and wait for it to complete. Requests taking longer than
+// timeout_ns, unless 0, are canceled and fail with -ETIME.
+static int submit_await_timeout(
     io_uring_prepare_t prepare_func,
-    void* context) {
+    void* context,
+    unsigned sqe_flags,
+    uint32_t* cqe_flags,
+    uint64_t timeout_ns) {
   rocket_fiber_t* fiber = get_current_fiber();
-  rocket_engine_t* engine = rocket_executor_get_engine(fiber->executor);
+  uring_engine_t* engine = get_uring_engine();
+  if (engine == NULL) {
+    return -EOPNOTSUPP;
+  }
+
+  if (rocket_fiber_take_cancel(fiber)) {
+    return -ECANCELED;
+  }
 
   rocket_future_t future = {
       .completed = false,
@@ -98,33 +922,89 @@ static int io_uring_submit_await(
       .fiber = fiber,
   };
 
-  struct io_uring_sqe* sqe = io_uring_get_sqe(&engine->uring);
+  // The timeout is linked to the request, so both go in the same submission.
+  if (timeout_ns > 0) {
+    int ret = reserve_sqes(engine, 2);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+
+  struct io_uring_sqe* sqe = get_sqe(engine);
   if (sqe == NULL) {
-    perror("io_uring_get_sqe");
     return -1;
   }
 
   // Prepare the request using caller arguments.
   prepare_func(sqe, context);
+  io_uring_sqe_set_flags(sqe, sqe_flags);
 
   // Stash the future as user data associated with the request.
   io_uring_sqe_set_data(sqe, &future);
 
-  // Signal request submission.
-  if (io_uring_submit(&engine->uring) < 0) {
-    perror("io_uring_submit");
+  // The kernel reads the timeout on submission, which happens before this
+  // fiber resumes.
+  struct __kernel_timespec ts;
+  rocket_future_t timeout;
+  if (timeout_ns > 0) {
+    prep_link_timeout(engine, sqe, &ts, timeout_ns, &timeout);
+  }
+
+  // The request is only queued here. The executor submits all queued requests
+  // at once when it runs out of runnable fibers, unless enough of them pile up
+  // to reach the batch size first. With submission queue polling, submitting
+  // only publishes the request to the polling thread, so do it right away.
+  // On the fast path, submit right away too and skip waiting if the request
+  // completed inline.
+  bool fast_path = fast_path_allowed(engine);
+  if ((should_submit_now(engine) || fast_path) && uring_submit(engine) < 0) {
     return -1;
   }
+  if (fast_path) {
+    peek_completion(engine, &future);
+  }
 
-  // Wait for completion.
-  if (rocket_future_await(&future) < 0) {
+  // Wait for completion unless it's already there.
+  bool canceled;
+  if (rocket_future_await_request(&future, &future, &canceled) < 0) {
     perror("rocket_future_await");
     return -1;
   }
 
+  if (cqe_flags != NULL) {
+    *cqe_flags = future.flags;
+  }
+  if (timeout_ns > 0) {
+    // A cancellation of the fiber takes precedence.
+    int ret = await_link_timeout(&timeout, future.result);
+    return canceled ? future.result : ret;
+  }
   return future.result;
 }
 
+static int io_uring_submit_await_flags(
+    io_uring_prepare_t prepare_func,
+    void* context,
+    unsigned sqe_flags,
+    uint32_t* cqe_flags) {
+  // Polled engines don't support timeouts.
+  uring_engine_t* engine = get_uring_engine();
+  uint64_t timeout_ns =
+      engine != NULL && (engine->base.config.flags & ROCKET_ENGINE_IOPOLL)
+          ? 0
+          : get_current_fiber()->io_timeout_ns;
+  return submit_await_timeout(prepare_func, context, sqe_flags, cqe_flags,
+                              timeout_ns);
+}
+
+static int io_uring_submit_await(
+    io_uring_prepare_t prepare_func,
+    void* context,
+    unsigned sqe_flags) {
+  return io_uring_submit_await_flags(prepare_func, context, sqe_flags,
+                                     /*cqe_flags=*/NULL);
+}
+
 static void prepare_openat(struct io_uring_sqe* sqe, void* context) {
   openat_context_t* openat_context = (openat_context_t*)context;
   // Prepare the open request using caller arguments.
@@ -136,21 +1016,47 @@ static void prepare_openat(struct io_uring_sqe* sqe, void* context) {
       openat_context->pmode);
 }
 
-int openat_await(int dirfd, const char* pathname, int oflag, ...) {
-  mode_t pmode = 0;
-  if (__OPEN_NEEDS_MODE(oflag)) {
-    va_list args;
-    va_start(args, oflag);
-    pmode = va_arg(args, mode_t);
-    va_end(args);
+static int uring_openat(int dirfd, const char* pathname, int oflag,
+                        mode_t pmode) {
+  openat_context_t context;
+  context.dirfd = dirfd;
+  context.pathname = pathname;
+  context.oflag = oflag;
+  context.pmode = pmode;
+  return io_uring_submit_await(prepare_openat, &context, /*sqe_flags=*/0);
+}
+
+static void prepare_openat_direct(struct io_uring_sqe* sqe, void* context) {
+  openat_context_t* openat_context = (openat_context_t*)context;
+  io_uring_prep_openat_direct(
+      sqe,
+      openat_context->dirfd,
+      openat_context->pathname,
+      openat_context->oflag,
+      openat_context->pmode,
+      openat_context->file_index);
+}
+
+// The kernel returns the allocated slot for ROCKET_FILE_INDEX_ALLOC and 0 for
+// an explicit slot. Always return the slot.
+static int direct_result(int result, unsigned file_index) {
+  if (result < 0 || file_index == ROCKET_FILE_INDEX_ALLOC) {
+    return result;
   }
+  return file_index;
+}
 
+int openat_direct_await(int dirfd, const char* pathname, int oflag,
+                        mode_t mode, unsigned file_index) {
   openat_context_t context;
   context.dirfd = dirfd;
   context.pathname = pathname;
   context.oflag = oflag;
-  context.pmode = pmode;
-  return io_uring_submit_await(prepare_openat, &context);
+  context.pmode = mode;
+  context.file_index = file_index;
+  int result =
+      io_uring_submit_await(prepare_openat_direct, &context, /*sqe_flags=*/0);
+  return direct_result(result, file_index);
 }
 
 typedef struct {
@@ -170,13 +1076,56 @@ static void prepare_readat(struct io_uring_sqe* sqe, void* context) {
       readat_context->offset);
 }
 
-ssize_t readat_await(int fd, void* buf, size_t nbytes, off_t offset) {
+// On polled engines, check that a request meets the alignment constraints
+// of direct I/O, which the device would reject anyway. Returns 0 if it does
+// or the engine doesn't poll, -EINVAL otherwise.
+static int check_direct_io(const void* buf, size_t nbytes, off_t offset) {
+  uring_engine_t* engine = get_uring_engine();
+  if (engine == NULL || !(engine->base.config.flags & ROCKET_ENGINE_IOPOLL)) {
+    return 0;
+  }
+  if ((uintptr_t)buf % ROCKET_DIRECT_IO_ALIGNMENT != 0 ||
+      nbytes % ROCKET_DIRECT_IO_ALIGNMENT != 0 ||
+      offset % ROCKET_DIRECT_IO_ALIGNMENT != 0) {
+    return -EINVAL;
+  }
+  return 0;
+}
+
+static int check_direct_iov(const struct iovec* iov, int iovcnt,
+                            off_t offset) {
+  for (int i = 0; i < iovcnt; i++) {
+    int ret = check_direct_io(iov[i].iov_base, iov[i].iov_len, offset);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+static ssize_t submit_readat(int fd, void* buf, size_t nbytes, off_t offset,
+                             unsigned sqe_flags) {
+  int ret = check_direct_io(buf, nbytes, offset);
+  if (ret < 0) {
+    return ret;
+  }
+
   readat_context_t context;
   context.fd = fd;
   context.buf = buf;
   context.nbytes = nbytes;
   context.offset = offset;
-  return io_uring_submit_await(prepare_readat, &context);
+  return io_uring_submit_await(prepare_readat, &context, sqe_flags);
+}
+
+static ssize_t uring_readat(int fd, void* buf, size_t nbytes,
+                            off_t offset) {
+  return submit_readat(fd, buf, nbytes, offset, /*sqe_flags=*/0);
+}
+
+ssize_t readat_direct_await(int file_index, void* buf, size_t nbytes,
+                            off_t offset) {
+  return submit_readat(file_index, buf, nbytes, offset, IOSQE_FIXED_FILE);
 }
 
 typedef struct {
@@ -196,46 +1145,399 @@ static void prepare_writeat(struct io_uring_sqe* sqe, void* context) {
       writeat_context->offset);
 }
 
-ssize_t writeat_await(int fd, const void* buf, size_t nbytes, off_t offset) {
+static ssize_t submit_writeat(int fd, const void* buf, size_t nbytes,
+                              off_t offset, unsigned sqe_flags) {
+  int ret = check_direct_io(buf, nbytes, offset);
+  if (ret < 0) {
+    return ret;
+  }
+
   writeat_context_t context;
   context.fd = fd;
   context.buf = buf;
   context.nbytes = nbytes;
   context.offset = offset;
-  return io_uring_submit_await(prepare_writeat, &context);
+  return io_uring_submit_await(prepare_writeat, &context, sqe_flags);
 }
 
-static void prepare_close(struct io_uring_sqe* sqe, void* context) {
-  int fd = *(int*)context;
-  io_uring_prep_close(sqe, fd);
+static ssize_t uring_writeat(int fd, const void* buf, size_t nbytes,
+                             off_t offset) {
+  return submit_writeat(fd, buf, nbytes, offset, /*sqe_flags=*/0);
 }
 
-int close_await(int fd) {
-  return io_uring_submit_await(prepare_close, &fd);
+ssize_t writeat_direct_await(int file_index, const void* buf, size_t nbytes,
+                             off_t offset) {
+  return submit_writeat(file_index, buf, nbytes, offset, IOSQE_FIXED_FILE);
 }
 
 typedef struct {
-  int sockfd;
-  struct sockaddr *addr;
-  socklen_t *addrlen;
-  int flags;
-} accept_context_t;
+  int fd;
+  void* buf;
+  size_t nbytes;
+  off_t offset;
+  int buf_index;
+} rw_fixed_context_t;
 
-static void prepare_accept(struct io_uring_sqe* sqe, void* context) {
-  accept_context_t* accept_context = context;
-  io_uring_prep_accept(sqe, accept_context->sockfd, accept_context->addr,
-                       accept_context->addrlen, accept_context->flags);
+static void prepare_readat_fixed(struct io_uring_sqe* sqe, void* context) {
+  rw_fixed_context_t* rw_context = context;
+  io_uring_prep_read_fixed(sqe, rw_context->fd, rw_context->buf,
+                           rw_context->nbytes, rw_context->offset,
+                           rw_context->buf_index);
 }
 
-int accept_await(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
-                 int flags) {
-  accept_context_t context;
-  context.sockfd = sockfd;
-  context.addr = addr;
-  context.addrlen = addrlen;
-  context.flags = flags;
-  return io_uring_submit_await(prepare_accept, &context);
-}
+ssize_t readat_fixed_await(int fd, void* buf, size_t nbytes, off_t offset,
+                           int buf_index) {
+  int ret = check_direct_io(buf, nbytes, offset);
+  if (ret < 0) {
+    return ret;
+  }
+
+  rw_fixed_context_t context;
+  context.fd = fd;
+  context.buf = buf;
+  context.nbytes = nbytes;
+  context.offset = offset;
+  context.buf_index = buf_index;
+  return io_uring_submit_await(prepare_readat_fixed, &context,
+                               /*sqe_flags=*/0);
+}
+
+static void prepare_writeat_fixed(struct io_uring_sqe* sqe, void* context) {
+  rw_fixed_context_t* rw_context = context;
+  io_uring_prep_write_fixed(sqe, rw_context->fd, rw_context->buf,
+                            rw_context->nbytes, rw_context->offset,
+                            rw_context->buf_index);
+}
+
+ssize_t writeat_fixed_await(int fd, const void* buf, size_t nbytes,
+                            off_t offset, int buf_index) {
+  int ret = check_direct_io(buf, nbytes, offset);
+  if (ret < 0) {
+    return ret;
+  }
+
+  rw_fixed_context_t context;
+  context.fd = fd;
+  context.buf = (void*)buf;
+  context.nbytes = nbytes;
+  context.offset = offset;
+  context.buf_index = buf_index;
+  return io_uring_submit_await(prepare_writeat_fixed, &context,
+                               /*sqe_flags=*/0);
+}
+
+typedef struct {
+  int fd;
+  const struct iovec* iov;
+  int iovcnt;
+  off_t offset;
+} rwv_context_t;
+
+static void prepare_readv(struct io_uring_sqe* sqe, void* context) {
+  rwv_context_t* rwv_context = context;
+  io_uring_prep_readv(sqe, rwv_context->fd, rwv_context->iov,
+                      rwv_context->iovcnt, rwv_context->offset);
+}
+
+static ssize_t uring_readv(int fd, const struct iovec* iov, int iovcnt,
+                           off_t offset) {
+  int ret = check_direct_iov(iov, iovcnt, offset);
+  if (ret < 0) {
+    return ret;
+  }
+
+  rwv_context_t context;
+  context.fd = fd;
+  context.iov = iov;
+  context.iovcnt = iovcnt;
+  context.offset = offset;
+  return io_uring_submit_await(prepare_readv, &context, /*sqe_flags=*/0);
+}
+
+static void prepare_writev(struct io_uring_sqe* sqe, void* context) {
+  rwv_context_t* rwv_context = context;
+  io_uring_prep_writev(sqe, rwv_context->fd, rwv_context->iov,
+                       rwv_context->iovcnt, rwv_context->offset);
+}
+
+static ssize_t uring_writev(int fd, const struct iovec* iov, int iovcnt,
+                            off_t offset) {
+  int ret = check_direct_iov(iov, iovcnt, offset);
+  if (ret < 0) {
+    return ret;
+  }
+
+  rwv_context_t context;
+  context.fd = fd;
+  context.iov = iov;
+  context.iovcnt = iovcnt;
+  context.offset = offset;
+  return io_uring_submit_await(prepare_writev, &context, /*sqe_flags=*/0);
+}
+
+typedef struct {
+  int fd;
+  unsigned flags;
+  off_t offset;
+  off_t nbytes;
+} sync_context_t;
+
+static void prepare_fsync(struct io_uring_sqe* sqe, void* context) {
+  sync_context_t* sync_context = context;
+  unsigned flags = (sync_context->flags & ROCKET_FSYNC_DATASYNC)
+                       ? IORING_FSYNC_DATASYNC
+                       : 0;
+  io_uring_prep_fsync(sqe, sync_context->fd, flags);
+}
+
+static int uring_fsync(int fd, unsigned flags) {
+  sync_context_t context;
+  context.fd = fd;
+  context.flags = flags;
+  return io_uring_submit_await(prepare_fsync, &context, /*sqe_flags=*/0);
+}
+
+static void prepare_sync_file_range(struct io_uring_sqe* sqe, void* context) {
+  sync_context_t* sync_context = context;
+  io_uring_prep_sync_file_range(sqe, sync_context->fd, sync_context->nbytes,
+                                sync_context->offset, sync_context->flags);
+}
+
+static int uring_sync_file_range(int fd, off_t offset, off_t nbytes,
+                                 unsigned flags) {
+  // The request only holds 32 bits of length.
+  if (nbytes < 0 || nbytes > UINT32_MAX) {
+    return -EINVAL;
+  }
+  sync_context_t context;
+  context.fd = fd;
+  context.flags = flags;
+  context.offset = offset;
+  context.nbytes = nbytes;
+  return io_uring_submit_await(prepare_sync_file_range, &context,
+                               /*sqe_flags=*/0);
+}
+
+static void prepare_close(struct io_uring_sqe* sqe, void* context) {
+  int fd = *(int*)context;
+  io_uring_prep_close(sqe, fd);
+}
+
+static int uring_close(int fd) {
+  return io_uring_submit_await(prepare_close, &fd, /*sqe_flags=*/0);
+}
+
+static void prepare_close_direct(struct io_uring_sqe* sqe, void* context) {
+  unsigned file_index = *(unsigned*)context;
+  io_uring_prep_close_direct(sqe, file_index);
+}
+
+int close_direct_await(unsigned file_index) {
+  return io_uring_submit_await(prepare_close_direct, &file_index,
+                               /*sqe_flags=*/0);
+}
+
+typedef struct {
+  int sockfd;
+  struct sockaddr *addr;
+  socklen_t *addrlen;
+  int flags;
+  // Fixed file slot to accept into. Only used by accept_direct_await.
+  unsigned file_index;
+} accept_context_t;
+
+static void prepare_accept(struct io_uring_sqe* sqe, void* context) {
+  accept_context_t* accept_context = context;
+  io_uring_prep_accept(sqe, accept_context->sockfd, accept_context->addr,
+                       accept_context->addrlen, accept_context->flags);
+}
+
+static int uring_accept(int sockfd, struct sockaddr *addr,
+                        socklen_t *addrlen, int flags) {
+  accept_context_t context;
+  context.sockfd = sockfd;
+  context.addr = addr;
+  context.addrlen = addrlen;
+  context.flags = flags;
+  return io_uring_submit_await(prepare_accept, &context, /*sqe_flags=*/0);
+}
+
+static void prepare_accept_direct(struct io_uring_sqe* sqe, void* context) {
+  accept_context_t* accept_context = context;
+  io_uring_prep_accept_direct(sqe, accept_context->sockfd,
+                              accept_context->addr, accept_context->addrlen,
+                              accept_context->flags,
+                              accept_context->file_index);
+}
+
+int accept_direct_await(int sockfd, struct sockaddr *addr, socklen_t *addrlen,
+                        int flags, unsigned file_index) {
+  accept_context_t context;
+  context.sockfd = sockfd;
+  context.addr = addr;
+  context.addrlen = addrlen;
+  context.flags = flags;
+  context.file_index = file_index;
+  int result =
+      io_uring_submit_await(prepare_accept_direct, &context, /*sqe_flags=*/0);
+  return direct_result(result, file_index);
+}
+
+// Multishot accept request spawning a task per accepted connection.
+typedef struct {
+  rocket_future_t request;
+  rocket_executor_t* executor;
+  rocket_task_func_t func;
+  // Whether connections are accepted into fixed file slots.
+  bool direct;
+  // Future of the fiber waiting for the request to stop.
+  rocket_future_t waiter;
+} accept_multishot_t;
+
+static rocket_future_t* accept_multishot_on_complete(rocket_future_t* request,
+                                                     int result,
+                                                     uint32_t flags) {
+  accept_multishot_t* accept = container_of(request, accept_multishot_t,
+                                            request);
+  if (result >= 0 &&
+      rocket_executor_submit_task(accept->executor, accept->func,
+                                  (void*)(intptr_t)result) == NULL) {
+    // Nobody would ever close the connection.
+    if (accept->direct) {
+      rocket_engine_update_file(rocket_executor_get_engine(accept->executor),
+                                result, -1);
+    } else {
+      close(result);
+    }
+  }
+  if (flags & IORING_CQE_F_MORE) {
+    return NULL;
+  }
+
+  accept->waiter.completed = true;
+  accept->waiter.error = 0;
+  accept->waiter.result = result;
+  return &accept->waiter;
+}
+
+static int submit_accept_multishot(int sockfd, rocket_task_func_t func,
+                                   int flags, bool direct) {
+  rocket_fiber_t* fiber = get_current_fiber();
+  uring_engine_t* engine = get_uring_engine();
+  if (engine == NULL) {
+    return -EOPNOTSUPP;
+  }
+
+  if (rocket_fiber_take_cancel(fiber)) {
+    return -ECANCELED;
+  }
+
+  accept_multishot_t accept;
+  memset(&accept, 0, sizeof(accept));
+  accept.request.on_complete = accept_multishot_on_complete;
+  accept.executor = fiber->executor;
+  accept.func = func;
+  accept.direct = direct;
+
+  while (true) {
+    struct io_uring_sqe* sqe = get_sqe(engine);
+    if (sqe == NULL) {
+      return -1;
+    }
+    if (direct) {
+      io_uring_prep_multishot_accept_direct(sqe, sockfd, /*addr=*/NULL,
+                                            /*addrlen=*/NULL, flags);
+    } else {
+      io_uring_prep_multishot_accept(sqe, sockfd, /*addr=*/NULL,
+                                     /*addrlen=*/NULL, flags);
+    }
+    io_uring_sqe_set_data(sqe, &accept.request);
+    if (should_submit_now(engine) && uring_submit(engine) < 0) {
+      return -1;
+    }
+
+    accept.waiter.completed = false;
+    accept.waiter.fiber = fiber;
+    bool canceled;
+    if (rocket_future_await_request(&accept.request, &accept.waiter,
+                                    &canceled) < 0) {
+      perror("rocket_future_await");
+      return -1;
+    }
+    // The kernel may also stop the request after a successful accept, e.g.
+    // when the completion queue overflows. Keep accepting in that case.
+    if (accept.waiter.result < 0) {
+      return accept.waiter.result;
+    }
+  }
+}
+
+int accept_multishot_await(int sockfd, rocket_task_func_t func, int flags) {
+  return submit_accept_multishot(sockfd, func, flags, /*direct=*/false);
+}
+
+int accept_multishot_direct_await(int sockfd, rocket_task_func_t func,
+                                  int flags) {
+  return submit_accept_multishot(sockfd, func, flags, /*direct=*/true);
+}
+
+typedef struct {
+  int domain;
+  int type;
+  int protocol;
+} socket_context_t;
+
+static void prepare_socket(struct io_uring_sqe* sqe, void* context) {
+  socket_context_t* socket_context = context;
+  io_uring_prep_socket(sqe, socket_context->domain, socket_context->type,
+                       socket_context->protocol, /*flags=*/0);
+}
+
+static int uring_socket(int domain, int type, int protocol) {
+  socket_context_t context;
+  context.domain = domain;
+  context.type = type;
+  context.protocol = protocol;
+  return io_uring_submit_await(prepare_socket, &context, /*sqe_flags=*/0);
+}
+
+typedef struct {
+  int sockfd;
+  const struct sockaddr* addr;
+  socklen_t addrlen;
+} connect_context_t;
+
+static void prepare_connect(struct io_uring_sqe* sqe, void* context) {
+  connect_context_t* connect_context = context;
+  io_uring_prep_connect(sqe, connect_context->sockfd, connect_context->addr,
+                        connect_context->addrlen);
+}
+
+static int uring_connect(int sockfd, const struct sockaddr* addr,
+                         socklen_t addrlen) {
+  connect_context_t context;
+  context.sockfd = sockfd;
+  context.addr = addr;
+  context.addrlen = addrlen;
+  return io_uring_submit_await(prepare_connect, &context, /*sqe_flags=*/0);
+}
+
+typedef struct {
+  int sockfd;
+  int how;
+} shutdown_context_t;
+
+static void prepare_shutdown(struct io_uring_sqe* sqe, void* context) {
+  shutdown_context_t* shutdown_context = context;
+  io_uring_prep_shutdown(sqe, shutdown_context->sockfd, shutdown_context->how);
+}
+
+static int uring_shutdown(int sockfd, int how) {
+  shutdown_context_t context;
+  context.sockfd = sockfd;
+  context.how = how;
+  return io_uring_submit_await(prepare_shutdown, &context, /*sqe_flags=*/0);
+}
 
 typedef struct {
   int sockfd;
@@ -250,13 +1552,157 @@ static void prepare_send(struct io_uring_sqe* sqe, void* context) {
                      send_context->len, send_context->flags);
 }
 
-ssize_t send_await(int sockfd, const void *buf, size_t len, int flags) {
+static ssize_t submit_send(int sockfd, const void *buf, size_t len, int flags,
+                           unsigned sqe_flags) {
   send_context_t context;
   context.sockfd = sockfd;
   context.buf = buf;
   context.len = len;
   context.flags = flags;
-  return io_uring_submit_await(prepare_send, &context);
+  return io_uring_submit_await(prepare_send, &context, sqe_flags);
+}
+
+static ssize_t uring_send(int sockfd, const void *buf, size_t len,
+                          int flags) {
+  uring_engine_t* engine = get_uring_engine();
+  size_t sent = 0;
+  if (fast_path_allowed(engine)) {
+    ssize_t ret =
+        inline_result(engine, send(sockfd, buf, len, flags | MSG_DONTWAIT));
+    if (ret != -EAGAIN) {
+      if (ret <= 0 || (size_t)ret == len || !(flags & MSG_WAITALL)) {
+        return ret;
+      }
+      // Send the rest through the ring.
+      sent = ret;
+    }
+  }
+
+  ssize_t ret = submit_send(sockfd, (const char*)buf + sent, len - sent, flags,
+                            /*sqe_flags=*/0);
+  if (sent > 0) {
+    return ret < 0 ? sent : sent + ret;
+  }
+  return ret;
+}
+
+ssize_t send_direct_await(int file_index, const void *buf, size_t len,
+                          int flags) {
+  return submit_send(file_index, buf, len, flags, IOSQE_FIXED_FILE);
+}
+
+// Zero-copy send request. Completes twice: once when the send is done and
+// once more when the kernel no longer references the buffer.
+typedef struct {
+  rocket_future_t request;
+  uring_engine_t* engine;
+  // Future of the fiber waiting for the send.
+  rocket_future_t* waiter;
+  rocket_release_func_t release;
+  void* release_context;
+} send_zc_t;
+
+static void send_zc_release(send_zc_t* send_zc) {
+  if (send_zc->release != NULL) {
+    send_zc->release(send_zc->release_context);
+  }
+  free(send_zc);
+}
+
+static rocket_future_t* send_zc_on_complete(rocket_future_t* request,
+                                            int result, uint32_t flags) {
+  send_zc_t* send_zc = container_of(request, send_zc_t, request);
+  if (flags & IORING_CQE_F_NOTIF) {
+    send_zc->engine->base.detached_requests--;
+    send_zc_release(send_zc);
+    return NULL;
+  }
+
+  rocket_future_t* waiter = send_zc->waiter;
+  waiter->completed = true;
+  waiter->error = 0;
+  waiter->result = result;
+  // Without a notification to come, e.g. on failure, the buffer is free now.
+  // Otherwise the executor keeps going until the notification arrives.
+  if (flags & IORING_CQE_F_MORE) {
+    send_zc->engine->base.detached_requests++;
+  } else {
+    send_zc_release(send_zc);
+  }
+  return waiter;
+}
+
+ssize_t send_zc_await(int sockfd, const void *buf, size_t len, int flags,
+                      rocket_release_func_t release, void* release_context) {
+  rocket_fiber_t* fiber = get_current_fiber();
+  uring_engine_t* engine = get_uring_engine();
+  if (engine == NULL) {
+    return -EOPNOTSUPP;
+  }
+  if (rocket_fiber_take_cancel(fiber)) {
+    return -ECANCELED;
+  }
+
+  // The timeout is linked to the send, so both go in the same submission.
+  uint64_t timeout_ns = fiber->io_timeout_ns;
+  if (timeout_ns > 0) {
+    int ret = reserve_sqes(engine, 2);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+
+  // Outlives this call until the notification arrives. Freed in
+  // send_zc_release.
+  send_zc_t* send_zc = malloc(sizeof(send_zc_t));
+  if (send_zc == NULL) {
+    return -ENOMEM;
+  }
+  rocket_future_t future = {
+      .completed = false,
+      .error = -1,
+      .result = -1,
+      .fiber = fiber,
+  };
+  memset(&send_zc->request, 0, sizeof(send_zc->request));
+  send_zc->request.on_complete = send_zc_on_complete;
+  send_zc->engine = engine;
+  send_zc->waiter = &future;
+  send_zc->release = release;
+  send_zc->release_context = release_context;
+
+  struct io_uring_sqe* sqe = get_sqe(engine);
+  if (sqe == NULL) {
+    free(send_zc);
+    return -1;
+  }
+  io_uring_prep_send_zc(sqe, sockfd, buf, len, flags, /*zc_flags=*/0);
+  io_uring_sqe_set_data(sqe, &send_zc->request);
+
+  struct __kernel_timespec ts;
+  rocket_future_t timeout;
+  if (timeout_ns > 0) {
+    prep_link_timeout(engine, sqe, &ts, timeout_ns, &timeout);
+  }
+
+  // The queued requests point at send_zc, future and timeout, so they have to
+  // be waited for even if submitting fails now. The executor submits them
+  // again.
+  if (should_submit_now(engine)) {
+    uring_submit(engine);
+  }
+
+  bool canceled;
+  if (rocket_future_await_request(&send_zc->request, &future,
+                                  &canceled) < 0) {
+    perror("rocket_future_await");
+    return -1;
+  }
+  if (timeout_ns > 0) {
+    int ret = await_link_timeout(&timeout, future.result);
+    return canceled ? future.result : ret;
+  }
+  return future.result;
 }
 
 typedef struct {
@@ -272,11 +1718,1099 @@ static void prepare_recv(struct io_uring_sqe* sqe, void* context) {
                      recv_context->len, recv_context->flags);
 }
 
-ssize_t recv_await(int sockfd, void *buf, size_t len, int flags) {
+static ssize_t submit_recv(int sockfd, void *buf, size_t len, int flags,
+                           unsigned sqe_flags) {
   recv_context_t context;
   context.sockfd = sockfd;
   context.buf = buf;
   context.len = len;
   context.flags = flags;
-  return io_uring_submit_await(prepare_recv, &context);
+  return io_uring_submit_await(prepare_recv, &context, sqe_flags);
+}
+
+static ssize_t uring_recv(int sockfd, void *buf, size_t len, int flags) {
+  uring_engine_t* engine = get_uring_engine();
+  size_t received = 0;
+  if (fast_path_allowed(engine)) {
+    ssize_t ret =
+        inline_result(engine, recv(sockfd, buf, len, flags | MSG_DONTWAIT));
+    if (ret != -EAGAIN) {
+      if (ret <= 0 || (size_t)ret == len || !(flags & MSG_WAITALL)) {
+        return ret;
+      }
+      // Wait for the rest through the ring.
+      received = ret;
+    }
+  }
+
+  ssize_t ret = submit_recv(sockfd, (char*)buf + received, len - received,
+                            flags, /*sqe_flags=*/0);
+  if (received > 0) {
+    return ret < 0 ? received : received + ret;
+  }
+  return ret;
+}
+
+ssize_t recv_direct_await(int file_index, void *buf, size_t len, int flags) {
+  return submit_recv(file_index, buf, len, flags, IOSQE_FIXED_FILE);
+}
+
+// Ring of buffers provided to the kernel, which picks one for a receive
+// request only once data arrives.
+struct rocket_buf_ring {
+  uring_engine_t* engine;
+  struct io_uring_buf_ring* br;
+  unsigned short bgid;
+  unsigned nr_buffers;
+  size_t buffer_size;
+  void* region;
+};
+
+rocket_buf_ring_t* rocket_buf_ring_create(rocket_engine_t* base,
+                                          unsigned short bgid,
+                                          unsigned nr_buffers,
+                                          size_t buffer_size) {
+  uring_engine_t* engine = to_uring_engine(base);
+  // Buffer lengths in the ring are 32 bits.
+  if (engine == NULL || buffer_size > UINT_MAX ||
+      !buffer_sizes_fit(nr_buffers, buffer_size)) {
+    return NULL;
+  }
+  rocket_buf_ring_t* ring = malloc(sizeof(rocket_buf_ring_t));
+  if (ring == NULL) {
+    return NULL;
+  }
+
+  if (posix_memalign(&ring->region, getpagesize(),
+                     nr_buffers * buffer_size) != 0) {
+    free(ring);
+    return NULL;
+  }
+
+  int ret;
+  ring->br = io_uring_setup_buf_ring(&engine->uring, nr_buffers, bgid,
+                                     /*flags=*/0, &ret);
+  if (ring->br == NULL) {
+    fprintf(stderr, "io_uring_setup_buf_ring: %s\n", strerror(-ret));
+    free(ring->region);
+    free(ring);
+    return NULL;
+  }
+
+  ring->engine = engine;
+  ring->bgid = bgid;
+  ring->nr_buffers = nr_buffers;
+  ring->buffer_size = buffer_size;
+
+  int mask = io_uring_buf_ring_mask(nr_buffers);
+  for (unsigned i = 0; i < nr_buffers; i++) {
+    io_uring_buf_ring_add(ring->br, (char*)ring->region + i * buffer_size,
+                          buffer_size, i, mask, i);
+  }
+  io_uring_buf_ring_advance(ring->br, nr_buffers);
+
+  return ring;
+}
+
+void rocket_buf_ring_destroy(rocket_buf_ring_t* ring) {
+  io_uring_free_buf_ring(&ring->engine->uring, ring->br, ring->nr_buffers,
+                         ring->bgid);
+  free(ring->region);
+  free(ring);
+}
+
+void rocket_buf_ring_release(rocket_buf_ring_t* ring, const rocket_buf_t* buf) {
+  void* data = (char*)ring->region + buf->bid * ring->buffer_size;
+  io_uring_buf_ring_add(ring->br, data, ring->buffer_size, buf->bid,
+                        io_uring_buf_ring_mask(ring->nr_buffers),
+                        /*buf_offset=*/0);
+  io_uring_buf_ring_advance(ring->br, 1);
+}
+
+// Fill buf with the buffer picked for a completion. Returns the result.
+static ssize_t get_selected_buffer(rocket_buf_ring_t* ring, int result,
+                                   uint32_t flags, rocket_buf_t* buf) {
+  if (result > 0) {
+    assert(flags & IORING_CQE_F_BUFFER);
+    buf->bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    buf->data = (char*)ring->region + buf->bid * ring->buffer_size;
+    buf->len = result;
+  }
+  return result;
+}
+
+typedef struct {
+  int sockfd;
+  int flags;
+  unsigned short bgid;
+} recv_select_context_t;
+
+static void prepare_recv_select(struct io_uring_sqe* sqe, void* context) {
+  recv_select_context_t* recv_context = context;
+  io_uring_prep_recv(sqe, recv_context->sockfd, /*buf=*/NULL, /*len=*/0,
+                     recv_context->flags);
+  sqe->buf_group = recv_context->bgid;
+}
+
+ssize_t recv_select_await(int sockfd, rocket_buf_ring_t* ring, int flags,
+                          rocket_buf_t* buf) {
+  recv_select_context_t context;
+  context.sockfd = sockfd;
+  context.flags = flags;
+  context.bgid = ring->bgid;
+  uint32_t cqe_flags = 0;
+  int result = io_uring_submit_await_flags(prepare_recv_select, &context,
+                                           IOSQE_BUFFER_SELECT, &cqe_flags);
+  return get_selected_buffer(ring, result, cqe_flags, buf);
+}
+
+typedef struct {
+  int result;
+  uint32_t flags;
+} recv_completion_t;
+
+// Multishot receive feeding a queue of completions that fibers consume.
+struct rocket_recv_stream {
+  int sockfd;
+  int flags;
+  rocket_buf_ring_t* ring;
+
+  // Future of the armed multishot receive request.
+  rocket_future_t request;
+  // True while the request keeps producing completions.
+  bool armed;
+
+  // Circular queue of completions not consumed yet. Each holds a buffer of
+  // the ring, except for the last one of an armed request.
+  recv_completion_t* completions;
+  unsigned capacity;
+  unsigned head;
+  unsigned count;
+
+  // Future of the fiber waiting for completions, if any.
+  rocket_future_t* waiter;
+};
+
+static rocket_future_t* recv_stream_on_complete(rocket_future_t* request,
+                                                int result, uint32_t flags) {
+  rocket_recv_stream_t* stream =
+      container_of(request, rocket_recv_stream_t, request);
+  if (!(flags & IORING_CQE_F_MORE)) {
+    stream->armed = false;
+  }
+
+  assert(stream->count < stream->capacity);
+  unsigned tail = (stream->head + stream->count) % stream->capacity;
+  stream->completions[tail].result = result;
+  stream->completions[tail].flags = flags;
+  stream->count++;
+
+  rocket_future_t* waiter = stream->waiter;
+  if (waiter == NULL || waiter->completed) {
+    return NULL;
+  }
+  waiter->completed = true;
+  waiter->error = 0;
+  waiter->result = result;
+  return waiter;
+}
+
+rocket_recv_stream_t* rocket_recv_stream_create(int sockfd,
+                                                rocket_buf_ring_t* ring,
+                                                int flags) {
+  rocket_recv_stream_t* stream = malloc(sizeof(rocket_recv_stream_t));
+  if (stream == NULL) {
+    return NULL;
+  }
+
+  stream->capacity = ring->nr_buffers + 1;
+  stream->completions = malloc(stream->capacity * sizeof(recv_completion_t));
+  if (stream->completions == NULL) {
+    free(stream);
+    return NULL;
+  }
+
+  stream->sockfd = sockfd;
+  stream->flags = flags;
+  stream->ring = ring;
+  memset(&stream->request, 0, sizeof(stream->request));
+  stream->request.on_complete = recv_stream_on_complete;
+  stream->armed = false;
+  stream->head = 0;
+  stream->count = 0;
+  stream->waiter = NULL;
+  return stream;
+}
+
+static int recv_stream_arm(rocket_recv_stream_t* stream) {
+  uring_engine_t* engine = stream->ring->engine;
+  struct io_uring_sqe* sqe = get_sqe(engine);
+  if (sqe == NULL) {
+    return -1;
+  }
+
+  io_uring_prep_recv_multishot(sqe, stream->sockfd, /*buf=*/NULL, /*len=*/0,
+                               stream->flags);
+  io_uring_sqe_set_flags(sqe, IOSQE_BUFFER_SELECT);
+  sqe->buf_group = stream->ring->bgid;
+  io_uring_sqe_set_data(sqe, &stream->request);
+  stream->armed = true;
+
+  if (should_submit_now(engine) && uring_submit(engine) < 0) {
+    return -1;
+  }
+  return 0;
+}
+
+// Block the current fiber until the stream has a new completion.
+static int recv_stream_wait(rocket_recv_stream_t* stream) {
+  rocket_future_t waiter = {
+      .completed = false,
+      .error = -1,
+      .result = -1,
+      .fiber = get_current_fiber(),
+  };
+  stream->waiter = &waiter;
+  // Cancelling the fiber stops the request, whose last completion then ends
+  // up in the queue.
+  bool canceled;
+  int ret =
+      rocket_future_await_request(&stream->request, &waiter, &canceled);
+  stream->waiter = NULL;
+  return ret;
+}
+
+ssize_t recv_stream_await(rocket_recv_stream_t* stream, rocket_buf_t* buf) {
+  if (stream->count == 0 && rocket_fiber_take_cancel(get_current_fiber())) {
+    return -ECANCELED;
+  }
+  while (stream->count == 0) {
+    // The request stops after errors, the end of the stream, and when the
+    // ring runs out of buffers. Receiving again re-arms it.
+    if (!stream->armed && recv_stream_arm(stream) < 0) {
+      return -1;
+    }
+    if (recv_stream_wait(stream) < 0) {
+      perror("rocket_future_await");
+      return -1;
+    }
+  }
+
+  recv_completion_t* completion = &stream->completions[stream->head];
+  stream->head = (stream->head + 1) % stream->capacity;
+  stream->count--;
+  return get_selected_buffer(stream->ring, completion->result,
+                             completion->flags, buf);
+}
+
+int rocket_recv_stream_close_await(rocket_recv_stream_t* stream) {
+  int ret = 0;
+  while (stream->armed) {
+    struct io_uring_sqe* sqe = get_sqe(stream->ring->engine);
+    if (sqe == NULL) {
+      return -1;
+    }
+    // The canceled request completes one last time, which wakes this fiber.
+    io_uring_prep_cancel(sqe, &stream->request, /*flags=*/0);
+    io_uring_sqe_set_data(sqe, NULL);
+    ret = recv_stream_wait(stream);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+
+  // Return the buffers of the completions never consumed.
+  rocket_buf_t buf;
+  while (stream->count > 0) {
+    if (recv_stream_await(stream, &buf) > 0) {
+      rocket_buf_ring_release(stream->ring, &buf);
+    }
+  }
+
+  free(stream->completions);
+  free(stream);
+  return 0;
+}
+
+typedef struct {
+  int sockfd;
+  struct msghdr* msg;
+  int flags;
+} msg_context_t;
+
+static void prepare_sendmsg(struct io_uring_sqe* sqe, void* context) {
+  msg_context_t* msg_context = context;
+  io_uring_prep_sendmsg(sqe, msg_context->sockfd, msg_context->msg,
+                        msg_context->flags);
+}
+
+static ssize_t uring_sendmsg(int sockfd, const struct msghdr* msg,
+                             int flags) {
+  uring_engine_t* engine = get_uring_engine();
+  // Partial messages can't be resumed through the ring, so waiting for all of
+  // it always goes there.
+  if (!(flags & MSG_WAITALL) && fast_path_allowed(engine)) {
+    ssize_t ret =
+        inline_result(engine, sendmsg(sockfd, msg, flags | MSG_DONTWAIT));
+    if (ret != -EAGAIN) {
+      return ret;
+    }
+  }
+
+  msg_context_t context;
+  context.sockfd = sockfd;
+  context.msg = (struct msghdr*)msg;
+  context.flags = flags;
+  return io_uring_submit_await(prepare_sendmsg, &context, /*sqe_flags=*/0);
+}
+
+static void prepare_recvmsg(struct io_uring_sqe* sqe, void* context) {
+  msg_context_t* msg_context = context;
+  io_uring_prep_recvmsg(sqe, msg_context->sockfd, msg_context->msg,
+                        msg_context->flags);
+}
+
+static ssize_t uring_recvmsg(int sockfd, struct msghdr* msg, int flags) {
+  uring_engine_t* engine = get_uring_engine();
+  if (!(flags & MSG_WAITALL) && fast_path_allowed(engine)) {
+    ssize_t ret =
+        inline_result(engine, recvmsg(sockfd, msg, flags | MSG_DONTWAIT));
+    if (ret != -EAGAIN) {
+      return ret;
+    }
+  }
+
+  msg_context_t context;
+  context.sockfd = sockfd;
+  context.msg = msg;
+  context.flags = flags;
+  return io_uring_submit_await(prepare_recvmsg, &context, /*sqe_flags=*/0);
+}
+
+typedef struct {
+  int fd_in;
+  off_t off_in;
+  int fd_out;
+  off_t off_out;
+  size_t nbytes;
+  unsigned flags;
+} splice_context_t;
+
+// A request of a chain.
+typedef struct {
+  rocket_future_t request;
+  rocket_chain_t* chain;
+  io_uring_prepare_t prepare;
+  unsigned sqe_flags;
+  union {
+    openat_context_t openat;
+    readat_context_t readat;
+    writeat_context_t writeat;
+    splice_context_t splice;
+    rwv_context_t rwv;
+    sync_context_t sync;
+    int fd;
+    unsigned file_index;
+  } context;
+  int result;
+} chain_request_t;
+
+struct rocket_chain {
+  unsigned flags;
+  unsigned max_requests;
+  unsigned nr_requests;
+  // Number of submitted requests not completed yet.
+  unsigned nr_pending;
+  // Future of the fiber waiting for the whole chain.
+  rocket_future_t waiter;
+  chain_request_t requests[];
+};
+
+rocket_chain_t* rocket_chain_create(unsigned max_requests, unsigned flags) {
+  rocket_chain_t* chain = malloc(sizeof(rocket_chain_t) +
+                                 max_requests * sizeof(chain_request_t));
+  if (chain == NULL) {
+    return NULL;
+  }
+
+  chain->flags = flags;
+  chain->max_requests = max_requests;
+  chain->nr_requests = 0;
+  chain->nr_pending = 0;
+  return chain;
+}
+
+void rocket_chain_destroy(rocket_chain_t* chain) {
+  assert(chain->nr_pending == 0);
+  free(chain);
+}
+
+void rocket_chain_reset(rocket_chain_t* chain) {
+  assert(chain->nr_pending == 0);
+  chain->nr_requests = 0;
+}
+
+// Append a request to the chain. Returns the request, or NULL if the chain is
+// full.
+static chain_request_t* chain_append(rocket_chain_t* chain,
+                                     io_uring_prepare_t prepare_func,
+                                     unsigned sqe_flags) {
+  if (chain->nr_requests == chain->max_requests) {
+    return NULL;
+  }
+  chain_request_t* request = &chain->requests[chain->nr_requests];
+  request->chain = chain;
+  request->prepare = prepare_func;
+  request->sqe_flags = sqe_flags;
+  request->result = -ECANCELED;
+  return request;
+}
+
+static int chain_index(rocket_chain_t* chain, chain_request_t* request) {
+  if (request == NULL) {
+    return -ENOSPC;
+  }
+  return chain->nr_requests++;
+}
+
+int rocket_chain_openat_direct(rocket_chain_t* chain, int dirfd,
+                               const char* pathname, int oflag, mode_t mode,
+                               unsigned file_index) {
+  chain_request_t* request =
+      chain_append(chain, prepare_openat_direct, /*sqe_flags=*/0);
+  if (request != NULL) {
+    request->context.openat.dirfd = dirfd;
+    request->context.openat.pathname = pathname;
+    request->context.openat.oflag = oflag;
+    request->context.openat.pmode = mode;
+    request->context.openat.file_index = file_index;
+  }
+  return chain_index(chain, request);
+}
+
+static int chain_readat(rocket_chain_t* chain, int fd, void* buf,
+                        size_t nbytes, off_t offset, unsigned sqe_flags) {
+  chain_request_t* request = chain_append(chain, prepare_readat, sqe_flags);
+  if (request != NULL) {
+    request->context.readat.fd = fd;
+    request->context.readat.buf = buf;
+    request->context.readat.nbytes = nbytes;
+    request->context.readat.offset = offset;
+  }
+  return chain_index(chain, request);
+}
+
+int rocket_chain_readat(rocket_chain_t* chain, int fd, void* buf,
+                        size_t nbytes, off_t offset) {
+  return chain_readat(chain, fd, buf, nbytes, offset, /*sqe_flags=*/0);
+}
+
+int rocket_chain_readat_direct(rocket_chain_t* chain, int file_index,
+                               void* buf, size_t nbytes, off_t offset) {
+  return chain_readat(chain, file_index, buf, nbytes, offset,
+                      IOSQE_FIXED_FILE);
+}
+
+static int chain_writeat(rocket_chain_t* chain, int fd, const void* buf,
+                         size_t nbytes, off_t offset, unsigned sqe_flags) {
+  chain_request_t* request = chain_append(chain, prepare_writeat, sqe_flags);
+  if (request != NULL) {
+    request->context.writeat.fd = fd;
+    request->context.writeat.buf = buf;
+    request->context.writeat.nbytes = nbytes;
+    request->context.writeat.offset = offset;
+  }
+  return chain_index(chain, request);
+}
+
+int rocket_chain_writeat(rocket_chain_t* chain, int fd, const void* buf,
+                         size_t nbytes, off_t offset) {
+  return chain_writeat(chain, fd, buf, nbytes, offset, /*sqe_flags=*/0);
+}
+
+int rocket_chain_writeat_direct(rocket_chain_t* chain, int file_index,
+                                const void* buf, size_t nbytes,
+                                off_t offset) {
+  return chain_writeat(chain, file_index, buf, nbytes, offset,
+                       IOSQE_FIXED_FILE);
+}
+
+int rocket_chain_close(rocket_chain_t* chain, int fd) {
+  chain_request_t* request =
+      chain_append(chain, prepare_close, /*sqe_flags=*/0);
+  if (request != NULL) {
+    request->context.fd = fd;
+  }
+  return chain_index(chain, request);
+}
+
+int rocket_chain_close_direct(rocket_chain_t* chain, unsigned file_index) {
+  chain_request_t* request =
+      chain_append(chain, prepare_close_direct, /*sqe_flags=*/0);
+  if (request != NULL) {
+    request->context.file_index = file_index;
+  }
+  return chain_index(chain, request);
+}
+
+static rocket_future_t* chain_on_complete(rocket_future_t* future, int result,
+                                          uint32_t flags) {
+  chain_request_t* request = container_of(future, chain_request_t, request);
+  if (request->prepare == prepare_openat_direct) {
+    result = direct_result(result, request->context.openat.file_index);
+  }
+  request->result = result;
+
+  // Only wake the fiber once the last request of the chain completes.
+  rocket_chain_t* chain = request->chain;
+  if (--chain->nr_pending > 0) {
+    return NULL;
+  }
+  chain->waiter.completed = true;
+  chain->waiter.error = 0;
+  chain->waiter.result = 0;
+  return &chain->waiter;
+}
+
+int rocket_chain_submit_await(rocket_chain_t* chain) {
+  if (chain->nr_requests == 0) {
+    return 0;
+  }
+
+  rocket_fiber_t* fiber = get_current_fiber();
+  uring_engine_t* engine = get_uring_engine();
+  if (engine == NULL) {
+    return -EOPNOTSUPP;
+  }
+  if (rocket_fiber_take_cancel(fiber)) {
+    return -ECANCELED;
+  }
+  int ret = reserve_sqes(engine, chain->nr_requests);
+  if (ret < 0) {
+    return ret;
+  }
+
+  unsigned link_flag = (chain->flags & ROCKET_CHAIN_HARDLINK)
+                           ? IOSQE_IO_HARDLINK
+                           : IOSQE_IO_LINK;
+  for (unsigned i = 0; i < chain->nr_requests; i++) {
+    chain_request_t* request = &chain->requests[i];
+    memset(&request->request, 0, sizeof(request->request));
+    request->request.on_complete = chain_on_complete;
+    request->result = -ECANCELED;
+
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&engine->uring);
+    assert(sqe != NULL);
+    request->prepare(sqe, &request->context);
+    unsigned sqe_flags = request->sqe_flags;
+    if (i + 1 < chain->nr_requests) {
+      sqe_flags |= link_flag;
+    }
+    io_uring_sqe_set_flags(sqe, sqe_flags);
+    io_uring_sqe_set_data(sqe, &request->request);
+  }
+  chain->nr_pending = chain->nr_requests;
+
+  chain->waiter.completed = false;
+  chain->waiter.error = -1;
+  chain->waiter.result = -1;
+  chain->waiter.fiber = fiber;
+  if (should_submit_now(engine) && uring_submit(engine) < 0) {
+    return -1;
+  }
+  if (rocket_future_await(&chain->waiter) < 0) {
+    perror("rocket_future_await");
+    return -1;
+  }
+
+  for (unsigned i = 0; i < chain->nr_requests; i++) {
+    if (chain->requests[i].result < 0) {
+      return chain->requests[i].result;
+    }
+  }
+  return 0;
+}
+
+int rocket_chain_result(const rocket_chain_t* chain, unsigned index) {
+  assert(index < chain->nr_requests);
+  return chain->requests[index].result;
+}
+
+
+static void prepare_splice(struct io_uring_sqe* sqe, void* context) {
+  splice_context_t* splice_context = context;
+  io_uring_prep_splice(sqe, splice_context->fd_in, splice_context->off_in,
+                       splice_context->fd_out, splice_context->off_out,
+                       splice_context->nbytes, splice_context->flags);
+}
+
+ssize_t splice_await(int fd_in, off_t off_in, int fd_out, off_t off_out,
+                     size_t nbytes, unsigned flags) {
+  splice_context_t context;
+  context.fd_in = fd_in;
+  context.off_in = off_in;
+  context.fd_out = fd_out;
+  context.off_out = off_out;
+  context.nbytes = nbytes;
+  context.flags = flags;
+  return io_uring_submit_await(prepare_splice, &context, /*sqe_flags=*/0);
+}
+
+static void prepare_tee(struct io_uring_sqe* sqe, void* context) {
+  splice_context_t* splice_context = context;
+  io_uring_prep_tee(sqe, splice_context->fd_in, splice_context->fd_out,
+                    splice_context->nbytes, splice_context->flags);
+}
+
+ssize_t tee_await(int fd_in, int fd_out, size_t nbytes, unsigned flags) {
+  splice_context_t context;
+  context.fd_in = fd_in;
+  context.fd_out = fd_out;
+  context.nbytes = nbytes;
+  context.flags = flags;
+  return io_uring_submit_await(prepare_tee, &context, /*sqe_flags=*/0);
+}
+
+int rocket_chain_splice(rocket_chain_t* chain, int fd_in, off_t off_in,
+                        int fd_out, off_t off_out, size_t nbytes,
+                        unsigned flags) {
+  chain_request_t* request =
+      chain_append(chain, prepare_splice, /*sqe_flags=*/0);
+  if (request != NULL) {
+    request->context.splice.fd_in = fd_in;
+    request->context.splice.off_in = off_in;
+    request->context.splice.fd_out = fd_out;
+    request->context.splice.off_out = off_out;
+    request->context.splice.nbytes = nbytes;
+    request->context.splice.flags = flags;
+  }
+  return chain_index(chain, request);
+}
+
+int rocket_chain_writev(rocket_chain_t* chain, int fd,
+                        const struct iovec* iov, int iovcnt, off_t offset) {
+  chain_request_t* request =
+      chain_append(chain, prepare_writev, /*sqe_flags=*/0);
+  if (request != NULL) {
+    request->context.rwv.fd = fd;
+    request->context.rwv.iov = iov;
+    request->context.rwv.iovcnt = iovcnt;
+    request->context.rwv.offset = offset;
+  }
+  return chain_index(chain, request);
+}
+
+int rocket_chain_fsync(rocket_chain_t* chain, int fd, unsigned flags) {
+  chain_request_t* request =
+      chain_append(chain, prepare_fsync, /*sqe_flags=*/0);
+  if (request != NULL) {
+    request->context.sync.fd = fd;
+    request->context.sync.flags = flags;
+  }
+  return chain_index(chain, request);
 }
+
+// Bytes a sendfile_await pipe is asked to hold. Larger pipes move more data
+// per round trip.
+#define SENDFILE_PIPE_SIZE (1 << 20)
+
+ssize_t sendfile_await(int out_sock, int in_fd, off_t offset, size_t len) {
+  int pipefd[2];
+  if (pipe2(pipefd, O_CLOEXEC) < 0) {
+    return -errno;
+  }
+  // Unprivileged users may be limited to smaller pipes. Go with the default
+  // size then.
+  fcntl(pipefd[1], F_SETPIPE_SZ, SENDFILE_PIPE_SIZE);
+  int pipe_size = fcntl(pipefd[1], F_GETPIPE_SZ);
+  if (pipe_size <= 0) {
+    pipe_size = getpagesize();
+  }
+
+  rocket_chain_t* chain = rocket_chain_create(/*max_requests=*/2, 0);
+  if (chain == NULL) {
+    close(pipefd[0]);
+    close(pipefd[1]);
+    return -ENOMEM;
+  }
+
+  ssize_t total = 0;
+  ssize_t ret = 0;
+  while ((size_t)total < len) {
+    size_t chunk = len - total;
+    if (chunk > (size_t)pipe_size) {
+      chunk = pipe_size;
+    }
+
+    // Move the chunk from the file into the pipe and from the pipe into the
+    // socket in one round trip. A short splice from the file cancels the
+    // second one.
+    rocket_chain_reset(chain);
+    rocket_chain_splice(chain, in_fd, offset + total, pipefd[1], -1, chunk,
+                        SPLICE_F_MOVE);
+    rocket_chain_splice(chain, pipefd[0], -1, out_sock, -1, chunk,
+                        SPLICE_F_MOVE);
+    int err = rocket_chain_submit_await(chain);
+    int in_pipe = rocket_chain_result(chain, 0);
+    int out = rocket_chain_result(chain, 1);
+    if (in_pipe == -ECANCELED) {
+      // The chain could not be submitted at all.
+      in_pipe = err;
+    }
+    if (in_pipe <= 0) {
+      // Failure or end of file.
+      ret = in_pipe;
+      break;
+    }
+    if (out < 0 && out != -ECANCELED) {
+      ret = out;
+      break;
+    }
+
+    // Drain what is left in the pipe.
+    ssize_t sent = out > 0 ? out : 0;
+    while (sent < in_pipe) {
+      ssize_t nbytes =
+          splice_await(pipefd[0], -1, out_sock, -1, in_pipe - sent,
+                       SPLICE_F_MOVE);
+      if (nbytes <= 0) {
+        ret = nbytes < 0 ? nbytes : -EPIPE;
+        break;
+      }
+      sent += nbytes;
+    }
+    total += sent;
+    if (ret < 0) {
+      break;
+    }
+  }
+
+  rocket_chain_destroy(chain);
+  close(pipefd[0]);
+  close(pipefd[1]);
+  // Like sendfile, report an error only if nothing was sent.
+  return total > 0 ? total : ret;
+}
+
+static void prepare_timeout(struct io_uring_sqe* sqe, void* context) {
+  io_uring_prep_timeout(sqe, context, /*count=*/0, /*flags=*/0);
+}
+
+static int uring_sleep(uint64_t duration_ns) {
+  struct __kernel_timespec ts;
+  ts.tv_sec = duration_ns / 1000000000;
+  ts.tv_nsec = duration_ns % 1000000000;
+  // The I/O timeout of the fiber doesn't apply to sleeping.
+  int result = submit_await_timeout(prepare_timeout, &ts, /*sqe_flags=*/0,
+                                    /*cqe_flags=*/NULL, /*timeout_ns=*/0);
+  return result == -ETIME ? 0 : result;
+}
+
+static void prepare_cancel_fd(struct io_uring_sqe* sqe, void* context) {
+  int fd = *(int*)context;
+  io_uring_prep_cancel_fd(sqe, fd, IORING_ASYNC_CANCEL_ALL);
+}
+
+static int uring_cancel_fd(int fd) {
+  int ret = io_uring_submit_await(prepare_cancel_fd, &fd, /*sqe_flags=*/0);
+  // The kernel fails if no request matched.
+  return ret == -ENOENT ? 0 : ret;
+}
+
+static void prepare_cancel_fd_direct(struct io_uring_sqe* sqe, void* context) {
+  unsigned file_index = *(unsigned*)context;
+  io_uring_prep_cancel_fd(sqe, file_index,
+                          IORING_ASYNC_CANCEL_ALL |
+                              IORING_ASYNC_CANCEL_FD_FIXED);
+}
+
+int cancel_fd_direct_await(unsigned file_index) {
+  int ret = io_uring_submit_await(prepare_cancel_fd_direct, &file_index,
+                                  /*sqe_flags=*/0);
+  return ret == -ENOENT ? 0 : ret;
+}
+
+static long uring_offload(rocket_offload_func_t func, void* arg) {
+  rocket_fiber_t* fiber = get_current_fiber();
+  uring_engine_t* engine = get_uring_engine();
+  // The executor learns about returned calls through a poll request on the
+  // eventfd of the pool, which polled rings reject.
+  if (engine->base.config.flags & ROCKET_ENGINE_IOPOLL) {
+    return -EOPNOTSUPP;
+  }
+  if (rocket_fiber_take_cancel(fiber)) {
+    return -ECANCELED;
+  }
+
+  if (engine->offload == NULL) {
+    engine->offload =
+        rocket_offload_pool_create(engine->base.config.offload_threads);
+    if (engine->offload == NULL) {
+      return -ENOMEM;
+    }
+    engine->offload_poll.on_complete = offload_poll_on_complete;
+  }
+
+  offload_request_t request;
+  memset(&request, 0, sizeof(request));
+  request.future.fiber = fiber;
+  request.future.error = -1;
+  request.future.result = -1;
+  request.job.func = func;
+  request.job.context = arg;
+  int ret = rocket_offload_pool_submit(engine->offload, &request.job);
+  if (ret < 0) {
+    return ret;
+  }
+  engine->offload_running++;
+  arm_offload_poll(engine);
+
+  // The call can't be canceled, so this isn't a request for the fiber.
+  if (rocket_future_await(&request.future) < 0) {
+    perror("rocket_future_await");
+    return -1;
+  }
+  return request.job.result;
+}
+
+typedef struct {
+  int dirfd;
+  const char* pathname;
+  int flags;
+  unsigned mask;
+  struct statx* statxbuf;
+} statx_context_t;
+
+static void prepare_statx(struct io_uring_sqe* sqe, void* context) {
+  statx_context_t* statx_context = context;
+  io_uring_prep_statx(sqe, statx_context->dirfd, statx_context->pathname,
+                      statx_context->flags, statx_context->mask,
+                      statx_context->statxbuf);
+}
+
+static int uring_statx(int dirfd, const char* pathname, int flags,
+                       unsigned mask, struct statx* statxbuf) {
+  statx_context_t context = {dirfd, pathname, flags, mask, statxbuf};
+  return io_uring_submit_await(prepare_statx, &context, /*sqe_flags=*/0);
+}
+
+typedef struct {
+  int fd;
+  int mode;
+  off_t offset;
+  off_t len;
+} fallocate_context_t;
+
+static void prepare_fallocate(struct io_uring_sqe* sqe, void* context) {
+  fallocate_context_t* fallocate_context = context;
+  io_uring_prep_fallocate(sqe, fallocate_context->fd, fallocate_context->mode,
+                          fallocate_context->offset, fallocate_context->len);
+}
+
+static int uring_fallocate(int fd, int mode, off_t offset, off_t len) {
+  fallocate_context_t context = {fd, mode, offset, len};
+  return io_uring_submit_await(prepare_fallocate, &context, /*sqe_flags=*/0);
+}
+
+static void prepare_ftruncate(struct io_uring_sqe* sqe, void* context) {
+  fallocate_context_t* ftruncate_context = context;
+  io_uring_prep_ftruncate(sqe, ftruncate_context->fd, ftruncate_context->len);
+}
+
+static long run_ftruncate(void* context) {
+  fallocate_context_t* ftruncate_context = context;
+  return ftruncate(ftruncate_context->fd, ftruncate_context->len) < 0 ? -errno
+                                                                      : 0;
+}
+
+static int uring_ftruncate(int fd, off_t length) {
+  fallocate_context_t context = {fd, 0, 0, length};
+  if (!get_uring_engine()->has_ftruncate) {
+    return uring_offload(run_ftruncate, &context);
+  }
+  return io_uring_submit_await(prepare_ftruncate, &context, /*sqe_flags=*/0);
+}
+
+typedef struct {
+  int olddirfd;
+  const char* oldpath;
+  int newdirfd;
+  const char* newpath;
+  unsigned flags;
+  mode_t mode;
+} path_context_t;
+
+static void prepare_unlinkat(struct io_uring_sqe* sqe, void* context) {
+  path_context_t* path_context = context;
+  io_uring_prep_unlinkat(sqe, path_context->olddirfd, path_context->oldpath,
+                         path_context->flags);
+}
+
+static int uring_unlinkat(int dirfd, const char* pathname, int flags) {
+  path_context_t context = {dirfd, pathname, -1, NULL, flags, 0};
+  return io_uring_submit_await(prepare_unlinkat, &context, /*sqe_flags=*/0);
+}
+
+static void prepare_renameat(struct io_uring_sqe* sqe, void* context) {
+  path_context_t* path_context = context;
+  io_uring_prep_renameat(sqe, path_context->olddirfd, path_context->oldpath,
+                         path_context->newdirfd, path_context->newpath,
+                         path_context->flags);
+}
+
+static int uring_renameat(int olddirfd, const char* oldpath, int newdirfd,
+                          const char* newpath, unsigned flags) {
+  path_context_t context = {olddirfd, oldpath, newdirfd, newpath, flags, 0};
+  return io_uring_submit_await(prepare_renameat, &context, /*sqe_flags=*/0);
+}
+
+static void prepare_mkdirat(struct io_uring_sqe* sqe, void* context) {
+  path_context_t* path_context = context;
+  io_uring_prep_mkdirat(sqe, path_context->olddirfd, path_context->oldpath,
+                        path_context->mode);
+}
+
+static int uring_mkdirat(int dirfd, const char* pathname, mode_t mode) {
+  path_context_t context = {dirfd, pathname, -1, NULL, 0, mode};
+  return io_uring_submit_await(prepare_mkdirat, &context, /*sqe_flags=*/0);
+}
+
+typedef struct {
+  int fd;
+  void* addr;
+  off_t offset;
+  off_t len;
+  int advice;
+} advise_context_t;
+
+// Largest range a single advice request covers, since the request only holds
+// 32 bits of length. Larger ranges are split.
+#define MAX_ADVISE_LEN (1UL << 30)
+
+static void prepare_fadvise(struct io_uring_sqe* sqe, void* context) {
+  advise_context_t* advise_context = context;
+  io_uring_prep_fadvise(sqe, advise_context->fd, advise_context->offset,
+                        advise_context->len, advise_context->advice);
+}
+
+static int uring_fadvise(int fd, off_t offset, off_t len, int advice) {
+  if (len < 0) {
+    return -EINVAL;
+  }
+  // A length of 0 means up to the end of the file, in a single request.
+  do {
+    off_t chunk_len = len > (off_t)MAX_ADVISE_LEN ? (off_t)MAX_ADVISE_LEN : len;
+    advise_context_t context = {fd, NULL, offset, chunk_len, advice};
+    int ret =
+        io_uring_submit_await(prepare_fadvise, &context, /*sqe_flags=*/0);
+    if (ret < 0) {
+      return ret;
+    }
+    offset += chunk_len;
+    len -= chunk_len;
+  } while (len > 0);
+  return 0;
+}
+
+static void prepare_madvise(struct io_uring_sqe* sqe, void* context) {
+  advise_context_t* advise_context = context;
+  io_uring_prep_madvise(sqe, advise_context->addr, advise_context->len,
+                        advise_context->advice);
+}
+
+static int uring_madvise(void* addr, size_t len, int advice) {
+  do {
+    size_t chunk_len = len > MAX_ADVISE_LEN ? MAX_ADVISE_LEN : len;
+    advise_context_t context = {-1, addr, 0, chunk_len, advice};
+    int ret =
+        io_uring_submit_await(prepare_madvise, &context, /*sqe_flags=*/0);
+    if (ret < 0) {
+      return ret;
+    }
+    addr = (char*)addr + chunk_len;
+    len -= chunk_len;
+  } while (len > 0);
+  return 0;
+}
+
+static rocket_future_t* prefetch_on_complete(rocket_future_t* request,
+                                             int result, uint32_t flags) {
+  uring_engine_t* engine =
+      container_of(request, uring_engine_t, prefetch_request);
+  engine->base.detached_requests--;
+  return NULL;
+}
+
+static int uring_prefetch(int fd, off_t offset, off_t len) {
+  uring_engine_t* engine = get_uring_engine();
+  if (len < 0) {
+    return -EINVAL;
+  }
+  // Queue all the chunks or none, so that a caller trying again doesn't hint
+  // part of the range twice. A hint isn't worth parking the fiber for room in
+  // the submission queue.
+  off_t nr_chunks = len == 0 ? 1 : (len - 1) / (off_t)MAX_ADVISE_LEN + 1;
+  if (nr_chunks > (off_t)engine->uring.sq.ring_entries) {
+    return -EINVAL;
+  }
+  if (io_uring_sq_space_left(&engine->uring) < nr_chunks) {
+    // Submitting makes room, unless completions have to be reaped first.
+    uring_submit(engine);
+    if (io_uring_sq_space_left(&engine->uring) < nr_chunks) {
+      return -EBUSY;
+    }
+  }
+  do {
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&engine->uring);
+    off_t chunk_len = len > (off_t)MAX_ADVISE_LEN ? (off_t)MAX_ADVISE_LEN : len;
+    io_uring_prep_fadvise(sqe, fd, offset, chunk_len, POSIX_FADV_WILLNEED);
+    // Nobody waits for the readahead, but the executor keeps running until
+    // it's submitted and completed.
+    io_uring_sqe_set_data(sqe, &engine->prefetch_request);
+    engine->base.detached_requests++;
+    offset += chunk_len;
+    len -= chunk_len;
+  } while (len > 0);
+
+  if (should_submit_now(engine)) {
+    int ret = uring_submit(engine);
+    if (ret < 0) {
+      return ret;
+    }
+  }
+  return 0;
+}
+
+static const rocket_engine_ops_t uring_engine_ops = {
+    .destroy = uring_destroy,
+    .await_completions = uring_await_completions,
+    .cancel = uring_cancel,
+    .openat = uring_openat,
+    .readat = uring_readat,
+    .writeat = uring_writeat,
+    .close = uring_close,
+    .readv = uring_readv,
+    .writev = uring_writev,
+    .accept = uring_accept,
+    .socket = uring_socket,
+    .connect = uring_connect,
+    .shutdown = uring_shutdown,
+    .send = uring_send,
+    .recv = uring_recv,
+    .sendmsg = uring_sendmsg,
+    .recvmsg = uring_recvmsg,
+    .sleep = uring_sleep,
+    .cancel_fd = uring_cancel_fd,
+    .fsync = uring_fsync,
+    .sync_file_range = uring_sync_file_range,
+    .statx = uring_statx,
+    .fallocate = uring_fallocate,
+    .ftruncate = uring_ftruncate,
+    .unlinkat = uring_unlinkat,
+    .renameat = uring_renameat,
+    .mkdirat = uring_mkdirat,
+    .fadvise = uring_fadvise,
+    .madvise = uring_madvise,
+    .prefetch = uring_prefetch,
+    .offload = uring_offload,
+};
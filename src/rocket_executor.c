@@ -31,6 +31,9 @@
 #include "rocket_future.h"
 #include "switch.h"
 
+// Maximum number of completions collected from the engine at once.
+#define COMPLETION_BATCH_SIZE 64
+
 typedef struct {
   rocket_fiber_t* fiber;
   void* task_func_context;
@@ -62,15 +65,19 @@ static void rocket_task_func_wrapper(void* context) {
 
 // 1) Create a fiber using the task.
 // 2) Append the fiber to runnable list.
-void rocket_executor_submit_task(
+rocket_fiber_t* rocket_executor_submit_task(
     rocket_executor_t* executor,
     rocket_task_func_t func,
     void* context) {
   // Destroyed in rocket_executor_execute.
   rocket_fiber_t* fiber = rocket_fiber_create(executor, func, context);
+  if (fiber == NULL) {
+    return NULL;
+  }
   init_run_context(
       &fiber->stk_ptr, rocket_task_func_wrapper, /*entry_point_context=*/fiber);
   dlist_push_tail(&executor->runnable, &fiber->list_node);
+  return fiber;
 }
 
 // Start executing the fibers in the executor.
@@ -98,16 +105,25 @@ void rocket_executor_execute(rocket_executor_t* executor) {
           break;
       }
 
-    } else if (!dlist_is_empty(&executor->blocked)) {
-      rocket_future_t* future = rocket_engine_await_next(executor->engine);
-      if (future == NULL) {
+    } else if (!dlist_is_empty(&executor->blocked) ||
+               rocket_engine_detached_requests(executor->engine) > 0) {
+      // Every runnable fiber has had its turn. Submit the requests they
+      // queued up and collect everything that completed in the meantime.
+      rocket_future_t* futures[COMPLETION_BATCH_SIZE];
+      int count = rocket_engine_await_completions(executor->engine, futures,
+                                                  COMPLETION_BATCH_SIZE);
+      if (count < 0) {
         return;
       }
 
-      // Remove the future from the blocked list and mark the fiber runnable.
-      dlist_remove_node(&future->list_node);
-      future->fiber->state = RUNNABLE;
-      dlist_push_tail(&executor->runnable, &future->fiber->list_node);
+      for (int i = 0; i < count; i++) {
+        // Remove the future from the blocked list and mark the fiber
+        // runnable.
+        rocket_future_t* future = futures[i];
+        dlist_remove_node(&future->list_node);
+        future->fiber->state = RUNNABLE;
+        dlist_push_tail(&executor->runnable, &future->fiber->list_node);
+      }
     } else {
       return;
     }
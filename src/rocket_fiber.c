@@ -26,6 +26,7 @@
 #include <stdint.h>
 
 #include "dlist.h"
+#include "rocket_engine.h"
 #include "rocket_executor.h"
 #include "rocket_fiber.h"
 #include "switch.h"
@@ -38,10 +39,16 @@ rocket_fiber_t* rocket_fiber_create(
     void* context) {
   // Freed in rocket_fiber_destroy.
   rocket_fiber_t* fiber = malloc(sizeof(rocket_fiber_t));
+  if (fiber == NULL) {
+    return NULL;
+  }
   fiber->state = RUNNABLE;
   fiber->executor = executor;
   fiber->task_func = func;
   fiber->context = context;
+  fiber->io_timeout_ns = 0;
+  fiber->request = NULL;
+  fiber->cancel_pending = false;
   if (stack_create(65536, &fiber->stack, &fiber->stk_ptr) < 0) {
     free(fiber);
     return NULL;
@@ -65,6 +72,26 @@ void rocket_fiber_yield() {
                      /*switch_context=*/NULL, set_current_fiber);
 }
 
+void rocket_fiber_set_io_timeout(uint64_t timeout_ns) {
+  get_current_fiber()->io_timeout_ns = timeout_ns;
+}
+
+bool rocket_fiber_take_cancel(rocket_fiber_t* fiber) {
+  if (!fiber->cancel_pending) {
+    return false;
+  }
+  fiber->cancel_pending = false;
+  return true;
+}
+
+void rocket_fiber_cancel(rocket_fiber_t* fiber) {
+  fiber->cancel_pending = true;
+  if (fiber->state == BLOCKED && fiber->request != NULL) {
+    rocket_engine_cancel(rocket_executor_get_engine(fiber->executor),
+                         fiber->request);
+  }
+}
+
 void rocket_fiber_destroy(rocket_fiber_t* fiber) {
   stack_destroy(&fiber->stack);
   free(fiber);
@@ -25,6 +25,9 @@
 
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include <rocket/rocket_fiber.h>
 #include <rocket/rocket_types.h>
 
@@ -49,6 +52,14 @@ typedef struct rocket_fiber {
   rocket_task_func_t task_func;
   // Context used in the function.
   void* context;
+  // See rocket_fiber_set_io_timeout. 0 means none.
+  uint64_t io_timeout_ns;
+  // Request the fiber is blocked on, which cancelling the fiber cancels.
+  // NULL if none.
+  struct rocket_future* request;
+  // True if the fiber was canceled and the await to fail with -ECANCELED
+  // hasn't returned yet.
+  bool cancel_pending;
 
   pal_stack_t stack;
   void* stk_ptr;
@@ -61,3 +72,6 @@ rocket_fiber_t* rocket_fiber_create(
 rocket_fiber_t* get_current_fiber();
 void set_current_fiber(void* fiber);
 void rocket_fiber_destroy(rocket_fiber_t* fiber);
+// Take a pending cancellation of fiber, which fails its next await. Returns
+// true if there was one.
+bool rocket_fiber_take_cancel(rocket_fiber_t* fiber);
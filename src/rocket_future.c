@@ -23,11 +23,12 @@
  * SOFTWARE.
  */
 
+#include <errno.h>
+
 #include "rocket_executor.h"
 #include "rocket_fiber.h"
 #include "rocket_future.h"
 
-// TODO: Add timeout
 int rocket_future_await(rocket_future_t* future) {
   rocket_fiber_t* fiber = get_current_fiber();
   assert(!dlist_node_in_list(&fiber->list_node));
@@ -45,3 +46,27 @@ int rocket_future_await(rocket_future_t* future) {
   return future->error;
 }
 
+int rocket_future_await_request(rocket_future_t* request,
+                                rocket_future_t* waiter, bool* canceled) {
+  rocket_fiber_t* fiber = waiter->fiber;
+  fiber->request = request;
+  int ret = rocket_future_await(waiter);
+  fiber->request = NULL;
+  *canceled = waiter->result == -ECANCELED && rocket_fiber_take_cancel(fiber);
+  return ret;
+}
+
+void rocket_future_complete(rocket_future_t* future, int result) {
+  future->completed = true;
+  future->error = 0;
+  future->result = result;
+
+  // The fiber is not waiting yet if the future isn't in the blocked list.
+  rocket_fiber_t* fiber = future->fiber;
+  if (fiber != NULL && fiber->state == BLOCKED &&
+      dlist_node_in_list(&future->list_node)) {
+    dlist_remove_node(&future->list_node);
+    fiber->state = RUNNABLE;
+    dlist_push_tail(&fiber->executor->runnable, &fiber->list_node);
+  }
+}
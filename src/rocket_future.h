@@ -25,6 +25,8 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include "dlist.h"
 #include "rocket_fiber.h"
 
@@ -42,7 +44,22 @@ struct rocket_future {
   int error;
   // Only support integer result for now.
   int result;
+  // Flags of the completion, e.g. the buffer the kernel picked.
+  uint32_t flags;
+
+  // Requests completing more than once (e.g. multishot requests) set this to
+  // handle each completion instead of waking the fiber. Returns the future
+  // to complete and wake, or NULL.
+  rocket_future_t* (*on_complete)(rocket_future_t* future, int result,
+                                  uint32_t flags);
 };
 
-// TODO: Add timeout
 int rocket_future_await(rocket_future_t* future);
+// Same as rocket_future_await for the future of a request, or of the fiber
+// waiting for it. Meanwhile, cancelling the fiber cancels request. Sets
+// canceled if the request failed because of that.
+int rocket_future_await_request(rocket_future_t* request,
+                                rocket_future_t* waiter, bool* canceled);
+// Complete future with result from a fiber of the same executor, and make the
+// fiber waiting on it runnable, if any.
+void rocket_future_complete(rocket_future_t* future, int result);
@@ -0,0 +1,221 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Andrew Rogers <andrurogerz@gmail.com>, Hechao Li
+ * <hechaol@outlook.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Group commit of records appended to a log file by many fibers.
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rocket/rocket_engine.h>
+#include <rocket/rocket_fiber.h>
+
+#include "dlist.h"
+#include "rocket_fiber.h"
+#include "rocket_future.h"
+
+// Maximum number of records written by one flush.
+#define LOG_BATCH_SIZE 64
+
+// A record waiting to be durable, on the stack of the appending fiber.
+typedef struct {
+  // Completed once the record is durable, or to lead a flush.
+  rocket_future_t future;
+  dlist_node_t node;
+  const void* buf;
+  size_t nbytes;
+  // Offset of the record once durable, or the error of the flush.
+  off_t result;
+  // Set when the fiber is woken to lead the next flush instead.
+  bool lead;
+} log_record_t;
+
+struct rocket_log {
+  int fd;
+  unsigned flags;
+  // Offset of the next record.
+  off_t tail;
+  // First error, after which every append fails.
+  int error;
+  // True while a fiber leads a flush.
+  bool flushing;
+  // Records waiting for the next flush.
+  dlist_node_t pending;
+  rocket_chain_t* chain;
+  struct iovec iov[LOG_BATCH_SIZE];
+};
+
+rocket_log_t* rocket_log_create(int fd, off_t offset, unsigned flags) {
+  rocket_log_t* log = malloc(sizeof(rocket_log_t));
+  if (log == NULL) {
+    return NULL;
+  }
+  log->chain = rocket_chain_create(/*max_requests=*/2, /*flags=*/0);
+  if (log->chain == NULL) {
+    free(log);
+    return NULL;
+  }
+
+  log->fd = fd;
+  log->flags = flags;
+  log->tail = offset;
+  log->error = 0;
+  log->flushing = false;
+  dlist_init(&log->pending);
+  return log;
+}
+
+void rocket_log_destroy(rocket_log_t* log) {
+  rocket_chain_destroy(log->chain);
+  free(log);
+}
+
+// Write iovcnt buffers of nbytes bytes in total at offset and make them
+// durable. Returns 0 on success, a negative errno on failure.
+static int write_and_sync(rocket_log_t* log, int iovcnt, off_t offset,
+                          size_t nbytes) {
+  unsigned sync_flags =
+      (log->flags & ROCKET_LOG_DATASYNC) ? ROCKET_FSYNC_DATASYNC : 0;
+  rocket_chain_reset(log->chain);
+  rocket_chain_writev(log->chain, log->fd, log->iov, iovcnt, offset);
+  rocket_chain_fsync(log->chain, log->fd, sync_flags);
+  int err = rocket_chain_submit_await(log->chain);
+  ssize_t written = rocket_chain_result(log->chain, 0);
+  int synced = rocket_chain_result(log->chain, 1);
+  if (err == -EOPNOTSUPP) {
+    // Engines without chains take two round trips.
+    written = writev_await(log->fd, log->iov, iovcnt, offset);
+    synced = written == (ssize_t)nbytes
+                 ? ((log->flags & ROCKET_LOG_DATASYNC) ? fdatasync_await(log->fd)
+                                                       : fsync_await(log->fd))
+                 : -ECANCELED;
+  } else if (written == -ECANCELED) {
+    // The chain could not be submitted at all.
+    written = err;
+  }
+
+  if (written < 0) {
+    return written;
+  }
+  if ((size_t)written < nbytes) {
+    // Out of space, most likely. The sync was canceled.
+    return -EIO;
+  }
+  return synced;
+}
+
+// Write and sync the oldest pending records, and complete them.
+static void flush(rocket_log_t* log) {
+  dlist_node_t batch;
+  dlist_init(&batch);
+  int iovcnt = 0;
+  size_t nbytes = 0;
+  while (iovcnt < LOG_BATCH_SIZE && !dlist_is_empty(&log->pending)) {
+    log_record_t* record =
+        container_of(dlist_pop_head(&log->pending), log_record_t, node);
+    record->result = log->tail + nbytes;
+    log->iov[iovcnt].iov_base = (void*)record->buf;
+    log->iov[iovcnt].iov_len = record->nbytes;
+    iovcnt++;
+    nbytes += record->nbytes;
+    dlist_push_tail(&batch, &record->node);
+  }
+
+  // The leading fiber being canceled is no failure of the log, which the
+  // other fibers of the batch wait for. Write the batch regardless, again if
+  // the cancellation stopped it, as the offsets don't change, and leave the
+  // cancellation to the next await of the fiber.
+  rocket_fiber_t* fiber = get_current_fiber();
+  bool canceled = false;
+  int ret = log->error;
+  if (ret == 0) {
+    while (true) {
+      canceled |= rocket_fiber_take_cancel(fiber);
+      ret = write_and_sync(log, iovcnt, log->tail, nbytes);
+      if (ret != -ECANCELED) {
+        break;
+      }
+      canceled = true;
+    }
+    if (ret < 0) {
+      log->error = ret;
+    } else {
+      log->tail += nbytes;
+    }
+  }
+  if (canceled) {
+    rocket_fiber_cancel(fiber);
+  }
+
+  while (!dlist_is_empty(&batch)) {
+    log_record_t* record =
+        container_of(dlist_pop_head(&batch), log_record_t, node);
+    if (ret < 0) {
+      record->result = ret;
+    }
+    rocket_future_complete(&record->future, 0);
+  }
+}
+
+off_t rocket_log_append_await(rocket_log_t* log, const void* buf,
+                              size_t nbytes) {
+  if (log->error < 0) {
+    return log->error;
+  }
+
+  log_record_t record;
+  memset(&record, 0, sizeof(record));
+  record.future.fiber = get_current_fiber();
+  record.future.error = -1;
+  record.future.result = -1;
+  record.buf = buf;
+  record.nbytes = nbytes;
+  dlist_push_tail(&log->pending, &record.node);
+
+  if (log->flushing) {
+    // Wait for a later flush to cover the record, or to be woken to lead it.
+    rocket_future_await(&record.future);
+    if (!record.lead) {
+      return record.result;
+    }
+  }
+
+  // Lead the flush. Let the runnable fibers append their records first, so
+  // that they make it into the same one.
+  log->flushing = true;
+  rocket_fiber_yield();
+  flush(log);
+
+  // Hand over to the oldest record left, whose fiber arrived during the
+  // flush.
+  if (!dlist_is_empty(&log->pending)) {
+    log_record_t* next = container_of(log->pending.next, log_record_t, node);
+    next->lead = true;
+    rocket_future_complete(&next->future, 0);
+  } else {
+    log->flushing = false;
+  }
+  return record.result;
+}
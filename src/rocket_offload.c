@@ -0,0 +1,171 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Andrew Rogers <andrurogerz@gmail.com>, Hechao Li
+ * <hechaol@outlook.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "rocket_offload.h"
+
+struct rocket_offload_pool {
+  pthread_mutex_t mutex;
+  // Signaled when jobs are queued or the pool stops.
+  pthread_cond_t cond;
+  // Jobs waiting for a thread.
+  dlist_node_t queued;
+  // Jobs finished but not reaped yet.
+  dlist_node_t done;
+  int eventfd;
+  bool stopping;
+
+  pthread_t* threads;
+  unsigned max_threads;
+  unsigned nr_threads;
+  // Threads waiting for jobs.
+  unsigned nr_idle;
+};
+
+rocket_offload_pool_t* rocket_offload_pool_create(unsigned nr_threads) {
+  rocket_offload_pool_t* pool = malloc(sizeof(rocket_offload_pool_t));
+  if (pool == NULL) {
+    return NULL;
+  }
+  pool->threads = malloc(nr_threads * sizeof(pthread_t));
+  pool->eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (pool->threads == NULL || pool->eventfd < 0) {
+    perror("rocket_offload_pool_create");
+    if (pool->eventfd >= 0) {
+      close(pool->eventfd);
+    }
+    free(pool->threads);
+    free(pool);
+    return NULL;
+  }
+
+  pthread_mutex_init(&pool->mutex, /*attr=*/NULL);
+  pthread_cond_init(&pool->cond, /*attr=*/NULL);
+  dlist_init(&pool->queued);
+  dlist_init(&pool->done);
+  pool->stopping = false;
+  pool->max_threads = nr_threads;
+  pool->nr_threads = 0;
+  pool->nr_idle = 0;
+  return pool;
+}
+
+void rocket_offload_pool_destroy(rocket_offload_pool_t* pool) {
+  pthread_mutex_lock(&pool->mutex);
+  pool->stopping = true;
+  pthread_cond_broadcast(&pool->cond);
+  pthread_mutex_unlock(&pool->mutex);
+  for (unsigned i = 0; i < pool->nr_threads; i++) {
+    pthread_join(pool->threads[i], /*retval=*/NULL);
+  }
+
+  pthread_cond_destroy(&pool->cond);
+  pthread_mutex_destroy(&pool->mutex);
+  close(pool->eventfd);
+  free(pool->threads);
+  free(pool);
+}
+
+int rocket_offload_pool_eventfd(rocket_offload_pool_t* pool) {
+  return pool->eventfd;
+}
+
+static void* worker_func(void* context) {
+  rocket_offload_pool_t* pool = context;
+  pthread_mutex_lock(&pool->mutex);
+  while (true) {
+    while (!pool->stopping && dlist_is_empty(&pool->queued)) {
+      pool->nr_idle++;
+      pthread_cond_wait(&pool->cond, &pool->mutex);
+      pool->nr_idle--;
+    }
+    if (pool->stopping) {
+      break;
+    }
+
+    rocket_offload_job_t* job =
+        container_of(dlist_pop_head(&pool->queued), rocket_offload_job_t,
+                     list_node);
+    pthread_mutex_unlock(&pool->mutex);
+    job->result = job->func(job->context);
+    pthread_mutex_lock(&pool->mutex);
+
+    dlist_push_tail(&pool->done, &job->list_node);
+    uint64_t value = 1;
+    if (write(pool->eventfd, &value, sizeof(value)) < 0) {
+      perror("write eventfd");
+    }
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+int rocket_offload_pool_submit(rocket_offload_pool_t* pool,
+                               rocket_offload_job_t* job) {
+  int ret = 0;
+  pthread_mutex_lock(&pool->mutex);
+  dlist_push_tail(&pool->queued, &job->list_node);
+  if (pool->nr_idle > 0) {
+    pthread_cond_signal(&pool->cond);
+  } else if (pool->nr_threads < pool->max_threads) {
+    // Start threads on demand.
+    int err = pthread_create(&pool->threads[pool->nr_threads], /*attr=*/NULL,
+                             worker_func, pool);
+    if (err == 0) {
+      pool->nr_threads++;
+    } else if (pool->nr_threads == 0) {
+      // Nothing would ever run the job.
+      dlist_remove_node(&job->list_node);
+      ret = -err;
+    }
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return ret;
+}
+
+unsigned rocket_offload_pool_reap(rocket_offload_pool_t* pool,
+                                  dlist_node_t* done) {
+  uint64_t value;
+  // Reset the counter. Jobs finishing from now on signal the eventfd again.
+  if (read(pool->eventfd, &value, sizeof(value)) < 0 && errno != EAGAIN) {
+    perror("read eventfd");
+  }
+
+  unsigned count = 0;
+  pthread_mutex_lock(&pool->mutex);
+  while (!dlist_is_empty(&pool->done)) {
+    dlist_push_tail(done, dlist_pop_head(&pool->done));
+    count++;
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return count;
+}
@@ -0,0 +1,57 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Andrew Rogers <andrurogerz@gmail.com>, Hechao Li
+ * <hechaol@outlook.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include "dlist.h"
+
+// Pool of worker threads running blocking calls on behalf of fibers.
+typedef struct rocket_offload_pool rocket_offload_pool_t;
+
+typedef struct rocket_offload_job rocket_offload_job_t;
+
+struct rocket_offload_job {
+  dlist_node_t list_node;
+  // Runs on a worker thread. Returns the result of the job.
+  long (*func)(void* context);
+  void* context;
+  long result;
+};
+
+// Create a pool of up to nr_threads threads, which are only started once jobs
+// come in.
+rocket_offload_pool_t* rocket_offload_pool_create(unsigned nr_threads);
+// Stop the threads once they finish their current job. Jobs not started yet
+// are dropped.
+void rocket_offload_pool_destroy(rocket_offload_pool_t* pool);
+// Non-blocking eventfd which becomes readable when jobs finish.
+int rocket_offload_pool_eventfd(rocket_offload_pool_t* pool);
+// Queue job to run on a worker thread. Returns 0 on success, a negative errno
+// on failure.
+int rocket_offload_pool_submit(rocket_offload_pool_t* pool,
+                               rocket_offload_job_t* job);
+// Move the finished jobs to the tail of done. Returns their number.
+unsigned rocket_offload_pool_reap(rocket_offload_pool_t* pool,
+                                  dlist_node_t* done);
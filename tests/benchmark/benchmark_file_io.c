@@ -26,6 +26,7 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -55,6 +56,8 @@ typedef struct {
   int cycles;
   size_t io_bytes;
   file_io_dispatch_table_t io_dispatch_table;
+  // If not NULL, I/O buffers are registered buffers of this engine.
+  rocket_engine_t *fixed_buffers_engine;
 } file_io_context_t;
 
 static file_io_dispatch_table_t sync_io_dispatch_table = {
@@ -85,16 +88,22 @@ static void *file_io_func(void *context_in) {
            context->thread_num);
 
   ssize_t ret = 0;
-  uint8_t *write_buf = malloc(context->io_bytes);
-  if (write_buf == NULL) {
-    fprintf(stderr, "Failed to allocate write buffer\n");
-    return (void *)-1;
+  uint8_t *write_buf = NULL;
+  uint8_t *read_buf = NULL;
+  int write_buf_index = -1;
+  int read_buf_index = -1;
+  rocket_engine_t *engine = context->fixed_buffers_engine;
+  if (engine != NULL) {
+    write_buf = rocket_engine_alloc_buffer(engine, &write_buf_index);
+    read_buf = rocket_engine_alloc_buffer(engine, &read_buf_index);
+  } else {
+    write_buf = malloc(context->io_bytes);
+    read_buf = malloc(context->io_bytes);
   }
-  uint8_t *read_buf = malloc(context->io_bytes);
-  if (read_buf == NULL) {
-    free(write_buf);
-    fprintf(stderr, "Failed to allocate read buffer\n");
-    return (void *)-1;
+  if (write_buf == NULL || read_buf == NULL) {
+    fprintf(stderr, "Failed to allocate buffers\n");
+    ret = -1;
+    goto cleanup;
   }
 
   for (int i = 0; i < context->cycles; i++) {
@@ -109,7 +118,11 @@ static void *file_io_func(void *context_in) {
     }
     // Write
     ssize_t bytes =
-        context->io_dispatch_table.writeat(fd, write_buf, context->io_bytes, 0);
+        engine != NULL
+            ? writeat_fixed_await(fd, write_buf, context->io_bytes, 0,
+                                  write_buf_index)
+            : context->io_dispatch_table.writeat(fd, write_buf,
+                                                 context->io_bytes, 0);
     if (bytes < 0) {
       fprintf(stderr, "Failed to write %zu bytes to file %s (fd: %d): %s\n",
               context->io_bytes, filename, fd, strerror(errno));
@@ -126,8 +139,11 @@ static void *file_io_func(void *context_in) {
       goto cleanup;
     }
     // Read
-    bytes =
-        context->io_dispatch_table.readat(fd, read_buf, context->io_bytes, 0);
+    bytes = engine != NULL
+                ? readat_fixed_await(fd, read_buf, context->io_bytes, 0,
+                                     read_buf_index)
+                : context->io_dispatch_table.readat(fd, read_buf,
+                                                    context->io_bytes, 0);
     if (bytes < 0) {
       fprintf(stderr, "Failed to read %zu bytes to file %s (fd: %d): %s\n",
               context->io_bytes, filename, fd, strerror(errno));
@@ -160,6 +176,68 @@ static void *file_io_func(void *context_in) {
   }
 cleanup:
   unlink(filename);
+  if (engine != NULL) {
+    if (write_buf != NULL) {
+      rocket_engine_free_buffer(engine, write_buf_index);
+    }
+    if (read_buf != NULL) {
+      rocket_engine_free_buffer(engine, read_buf_index);
+    }
+  } else {
+    free(write_buf);
+    free(read_buf);
+  }
+  return (void *)ret;
+}
+
+// Same cycle as file_io_func, but each one is a single chain of linked
+// requests on the fixed file slot of the fiber.
+static void *file_io_chain_func(void *context_in) {
+  file_io_context_t *context = context_in;
+  char filename[128] = {0};
+  snprintf(filename, sizeof(filename), "%s%d", context->filename_prefix,
+           context->thread_num);
+
+  ssize_t ret = 0;
+  unsigned file_index = context->thread_num;
+  uint8_t *write_buf = malloc(context->io_bytes);
+  uint8_t *read_buf = malloc(context->io_bytes);
+  rocket_chain_t *chain = rocket_chain_create(/*max_requests=*/4, 0);
+  if (write_buf == NULL || read_buf == NULL || chain == NULL) {
+    fprintf(stderr, "Failed to allocate buffers\n");
+    ret = -1;
+    goto cleanup;
+  }
+  rocket_chain_openat_direct(chain, AT_FDCWD, filename, O_CREAT | O_RDWR,
+                             0644, file_index);
+  rocket_chain_writeat_direct(chain, file_index, write_buf, context->io_bytes,
+                              0);
+  rocket_chain_readat_direct(chain, file_index, read_buf, context->io_bytes,
+                             0);
+  rocket_chain_close_direct(chain, file_index);
+
+  for (int i = 0; i < context->cycles; i++) {
+    int err = rocket_chain_submit_await(chain);
+    if (err < 0) {
+      fprintf(stderr, "Failed to open, write, read and close file %s: %s\n",
+              filename, strerror(-err));
+      // Make sure the slot is free for the next cycle.
+      close_direct_await(file_index);
+      ret = -1;
+      goto cleanup;
+    }
+    // Verify content
+    if (memcmp(read_buf, write_buf, context->io_bytes) != 0) {
+      fprintf(stderr, "Read buf doesn't match write buf!\n");
+      ret = -1;
+      goto cleanup;
+    }
+  }
+cleanup:
+  unlink(filename);
+  if (chain != NULL) {
+    rocket_chain_destroy(chain);
+  }
   free(write_buf);
   free(read_buf);
   return (void *)ret;
@@ -186,6 +264,7 @@ static int read_write_with_pthreads(const void *params_in) {
     contexts[i].cycles = params->num_cycles_per_thread;
     contexts[i].io_bytes = params->num_bytes_per_io;
     contexts[i].io_dispatch_table = sync_io_dispatch_table;
+    contexts[i].fixed_buffers_engine = NULL;
     int err =
         pthread_create(&threads[i], /*attr=*/NULL, file_io_func, &contexts[i]);
     if (err != 0) {
@@ -212,15 +291,33 @@ cleanup:
   return ret;
 }
 
-static int read_write_with_fibers(const void *params_in) {
-  const params_t *params = params_in;
-  rocket_engine_t *engine =
-      rocket_engine_create(/*queue_depth=*/params->num_threads);
+static int read_write_with_fibers_common(const params_t *params,
+                                         bool fixed_buffers, bool chains) {
+  // Each chain takes 4 submission queue entries.
+  rocket_engine_t *engine = rocket_engine_create(
+      /*queue_depth=*/chains ? 4 * params->num_threads : params->num_threads);
   rocket_executor_t *executor = rocket_executor_create(engine);
 
+  if (chains && rocket_engine_register_files(engine, params->num_threads) < 0) {
+    rocket_executor_destroy(executor);
+    rocket_engine_destroy(engine);
+    fprintf(stderr, "Failed to register files\n");
+    return -1;
+  }
+
+  if (fixed_buffers &&
+      rocket_engine_register_buffers(engine, 2 * params->num_threads,
+                                     params->num_bytes_per_io) < 0) {
+    rocket_executor_destroy(executor);
+    rocket_engine_destroy(engine);
+    fprintf(stderr, "Failed to register buffers\n");
+    return -1;
+  }
+
   file_io_context_t *contexts =
       malloc(sizeof(file_io_context_t) * params->num_threads);
   if (contexts == NULL) {
+    rocket_executor_destroy(executor);
     rocket_engine_destroy(engine);
     fprintf(stderr, "Failed to allocate io contexts\n");
     return -1;
@@ -231,7 +328,10 @@ static int read_write_with_fibers(const void *params_in) {
     contexts[i].cycles = params->num_cycles_per_thread;
     contexts[i].io_bytes = params->num_bytes_per_io;
     contexts[i].io_dispatch_table = async_io_dispatch_table;
-    rocket_executor_submit_task(executor, file_io_func, &contexts[i]);
+    contexts[i].fixed_buffers_engine = fixed_buffers ? engine : NULL;
+    rocket_executor_submit_task(executor,
+                                chains ? file_io_chain_func : file_io_func,
+                                &contexts[i]);
   }
   rocket_executor_execute(executor);
 
@@ -241,6 +341,21 @@ static int read_write_with_fibers(const void *params_in) {
   return 0;
 }
 
+static int read_write_with_fibers(const void *params_in) {
+  return read_write_with_fibers_common(params_in, /*fixed_buffers=*/false,
+                                       /*chains=*/false);
+}
+
+static int read_write_with_fibers_fixed_buffers(const void *params_in) {
+  return read_write_with_fibers_common(params_in, /*fixed_buffers=*/true,
+                                       /*chains=*/false);
+}
+
+static int read_write_with_fibers_chains(const void *params_in) {
+  return read_write_with_fibers_common(params_in, /*fixed_buffers=*/false,
+                                       /*chains=*/true);
+}
+
 void usage(const char *program) {
   fprintf(stdout,
           "Usage: %s -n <# of threads> -c <# of cycles per thread> -s "
@@ -279,5 +394,11 @@ int main(int argc, char **argv) {
   // Fiber + async IO
   benchmark("read write files with fibers", read_write_with_fibers, &params,
             print_params);
+  // Fiber + async IO with registered buffers
+  benchmark("read write files with fibers and registered buffers",
+            read_write_with_fibers_fixed_buffers, &params, print_params);
+  // Fiber + async IO with a chain of linked requests per cycle
+  benchmark("read write files with fibers and linked requests",
+            read_write_with_fibers_chains, &params, print_params);
   return 0;
 }
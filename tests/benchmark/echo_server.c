@@ -37,6 +37,7 @@
 
 #include <rocket/rocket_engine.h>
 #include <rocket/rocket_executor.h>
+#include <rocket/rocket_fiber.h>
 
 #define DEFAULT_PORT 4224
 
@@ -44,6 +45,12 @@
 #define MAX_MSG_SIZE 4096
 // Maximum number of concurrent connections.
 #define MAX_NUM_CONN 4096
+// Fibers wait for room in the submission queue when it's full, so it doesn't
+// need an entry per connection, unlike the completion queue.
+#define QUEUE_DEPTH 256
+
+// Number of receive buffers shared by all connections with -b.
+#define NUM_RECV_BUFS 1024
 
 #define INT_TO_VOIDPTR(i) (void*)(uintptr_t)(i)
 
@@ -148,9 +155,13 @@ static int run_echo_server(unsigned short port) {
   return ret;
 }
 
+// Nanoseconds a connection may stay idle with -t. 0 means forever.
+static uint64_t idle_timeout_ns;
+
 static void* async_echo(void* context) {
   int client_fd = (uintptr_t)context;
   char buf[MAX_MSG_SIZE];
+  rocket_fiber_set_io_timeout(idle_timeout_ns);
 
   while (true) {
     ssize_t recv_bytes = recv_await(client_fd, buf, MAX_MSG_SIZE, /*flags=*/0);
@@ -177,9 +188,58 @@ static void* async_echo(void* context) {
   return NULL;
 }
 
+// Ring of receive buffers shared by all connections with -b.
+static rocket_buf_ring_t *recv_buf_ring;
+
+static void* async_echo_buf_ring(void* context) {
+  int client_fd = (uintptr_t)context;
+  rocket_recv_stream_t *stream =
+      rocket_recv_stream_create(client_fd, recv_buf_ring, /*flags=*/0);
+  if (stream == NULL) {
+    fprintf(stderr, "Failed to create recv stream for client %d\n",
+            client_fd);
+    close(client_fd);
+    return NULL;
+  }
+
+  while (true) {
+    rocket_buf_t buf;
+    ssize_t recv_bytes = recv_stream_await(stream, &buf);
+    if (recv_bytes == -ENOBUFS) {
+      // Other connections hold all buffers. Let them make progress.
+      rocket_fiber_yield();
+      continue;
+    }
+    if (recv_bytes <= 0) {
+      if (recv_bytes < 0) {
+        fprintf(stderr, "Failed to recv message from client %d\n",
+                client_fd);
+      }
+      break;
+    }
+    ssize_t send_bytes =
+        send_await(client_fd, buf.data, recv_bytes, /*flags=*/0);
+    rocket_buf_ring_release(recv_buf_ring, &buf);
+    if (send_bytes < 0) {
+      fprintf(stderr, "Failed to send %ld bytes to client %d\n", send_bytes,
+              client_fd);
+      break;
+    } else if (send_bytes != recv_bytes) {
+      fprintf(stderr,
+              "Failed to send all %ld bytes to client %d. Sent %ld bytes\n",
+              recv_bytes, client_fd, send_bytes);
+      break;
+    }
+  }
+  rocket_recv_stream_close_await(stream);
+  close(client_fd);
+  return NULL;
+}
+
 typedef struct {
   unsigned short port;
   rocket_executor_t *executor;
+  rocket_task_func_t echo_func;
 } async_echo_server_context_t;
 
 static void* run_async_echo_server(void* context_in) {
@@ -190,6 +250,16 @@ static void* run_async_echo_server(void* context_in) {
     return INT_TO_VOIDPTR(-1);
   }
 
+  // A single multishot accept request spawns a fiber per connection.
+  int err = accept_multishot_await(listenfd, context->echo_func, /*flags=*/0);
+  if (err != -EINVAL && err != -EOPNOTSUPP) {
+    fprintf(stderr, "Failed to accept connections: %s\n", strerror(-err));
+    close(listenfd);
+    return INT_TO_VOIDPTR(-1);
+  }
+
+  // The kernel or the engine doesn't support multishot accept. Accept one at
+  // a time.
   while (true) {
     struct sockaddr_in clientaddr;
     socklen_t clientaddr_len = sizeof(clientaddr);
@@ -199,7 +269,7 @@ static void* run_async_echo_server(void* context_in) {
       fprintf(stderr, "Failed to accept connection\n");
       return INT_TO_VOIDPTR(-1);
     }
-    rocket_executor_submit_task(context->executor, async_echo,
+    rocket_executor_submit_task(context->executor, context->echo_func,
                                 INT_TO_VOIDPTR(clientfd));
   }
   // Should never reach here if everything goes well.
@@ -208,17 +278,31 @@ static void* run_async_echo_server(void* context_in) {
 }
 
 void usage(const char *program) {
-  fprintf(stdout, "Usage: %s [-p <port>] [-a]\n", program);
+  fprintf(stdout, "Usage: %s [-p <port>] [-a] [-b] [-e] [-f] [-s <us>] [-t <seconds>]\n",
+          program);
   fprintf(stdout, "Options: \n");
   fprintf(stdout, "\t-p <port> The port to listen on\n");
   fprintf(stdout, "\t-a Enable asynchrnous I/O\n");
+  fprintf(stdout,
+          "\t-b Receive into buffers shared by all connections (implies -a)\n");
+  fprintf(stdout, "\t-e Use the epoll engine instead of io_uring (implies -a)\n");
+  fprintf(stdout,
+          "\t-f Try sends and receives inline before the ring (implies -a)\n");
+  fprintf(stdout,
+          "\t-s <us> Busy-poll for completions before sleeping (implies -a)\n");
+  fprintf(stdout,
+          "\t-t <seconds> Drop connections idle for that long (only with -a)\n");
 }
 
 int main(int argc, char **argv) {
   int opt;
   int port = DEFAULT_PORT;
   bool async = false;
-  while ((opt = getopt(argc, argv, "p:a")) != -1) {
+  bool buf_ring = false;
+  rocket_engine_backend_t backend = ROCKET_ENGINE_IO_URING;
+  unsigned flags = 0;
+  unsigned busy_poll_us = 0;
+  while ((opt = getopt(argc, argv, "p:abefs:t:")) != -1) {
     switch (opt) {
     case 'p':
       port = atoi(optarg);
@@ -226,6 +310,25 @@ int main(int argc, char **argv) {
     case 'a':
       async = true;
       break;
+    case 'b':
+      async = true;
+      buf_ring = true;
+      break;
+    case 'e':
+      async = true;
+      backend = ROCKET_ENGINE_EPOLL;
+      break;
+    case 'f':
+      async = true;
+      flags |= ROCKET_ENGINE_FAST_PATH;
+      break;
+    case 's':
+      async = true;
+      busy_poll_us = atoi(optarg);
+      break;
+    case 't':
+      idle_timeout_ns = atoi(optarg) * 1000000000ULL;
+      break;
     default:
       usage(argv[0]);
       return -1;
@@ -234,19 +337,38 @@ int main(int argc, char **argv) {
   }
   if (async) {
     fprintf(stdout, "Running async echo server ...\n");
-    rocket_engine_t *engine =
-        rocket_engine_create(/*queue_depth=*/MAX_NUM_CONN);
+    rocket_engine_config_t config;
+    rocket_engine_config_init(&config, QUEUE_DEPTH);
+    // Every connection may have a request in flight.
+    config.cq_entries = MAX_NUM_CONN;
+    config.backend = backend;
+    config.flags = flags;
+    config.busy_poll_us = busy_poll_us;
+    rocket_engine_t *engine = rocket_engine_create_ex(&config);
     rocket_executor_t *executor = rocket_executor_create(engine);
 
     async_echo_server_context_t context;
     context.port = port;
     context.executor = executor;
+    context.echo_func = async_echo;
+    if (buf_ring) {
+      recv_buf_ring = rocket_buf_ring_create(engine, /*bgid=*/0, NUM_RECV_BUFS,
+                                             MAX_MSG_SIZE);
+      if (recv_buf_ring == NULL) {
+        fprintf(stderr, "Failed to create receive buffer ring\n");
+        return -1;
+      }
+      context.echo_func = async_echo_buf_ring;
+    }
 
     rocket_executor_submit_task(executor, run_async_echo_server, &context);
     rocket_executor_execute(executor);
 
     // Should never reach here if everything goes well.
     rocket_executor_destroy(executor);
+    if (recv_buf_ring != NULL) {
+      rocket_buf_ring_destroy(recv_buf_ring);
+    }
     rocket_engine_destroy(engine);
     return 0;
   } else {
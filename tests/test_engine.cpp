@@ -0,0 +1,394 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Andrew Rogers <andrurogerz@gmail.com>, Hechao Li
+ * <hechaol@outlook.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <rocket/rocket_engine.h>
+#include <rocket/rocket_executor.h>
+#include <rocket/rocket_fiber.h>
+
+#include <errno.h>
+#include <sys/socket.h>
+
+#include <gtest/gtest.h>
+
+#include "busy_poll.h"
+
+static const size_t queue_depth = 10;
+
+// Worker function writing a file and reading it back.
+static void* write_read_worker(void* context) {
+  const char* filename = (const char*)context;
+  int fd = openat_await(AT_FDCWD, filename, O_CREAT | O_RDWR, 0644);
+  EXPECT_GT(fd, 0);
+
+  const char write_buf[] = "rocket engine";
+  ssize_t nbytes = writeat_await(fd, write_buf, sizeof(write_buf), 0);
+  EXPECT_EQ(nbytes, sizeof(write_buf));
+
+  char read_buf[sizeof(write_buf)];
+  nbytes = readat_await(fd, read_buf, sizeof(read_buf), 0);
+  EXPECT_EQ(nbytes, sizeof(read_buf));
+  EXPECT_EQ(memcmp(read_buf, write_buf, sizeof(write_buf)), 0);
+
+  EXPECT_EQ(close_await(fd), 0);
+  EXPECT_EQ(unlink(filename), 0);
+  return nullptr;
+}
+
+// Run two write_read_worker fibers on an engine created with config.
+static void run_write_read_workers(const rocket_engine_config_t* config) {
+  rocket_engine_t* engine = rocket_engine_create_ex(config);
+  ASSERT_NE(engine, nullptr);
+
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  rocket_executor_submit_task(executor, write_read_worker, (void*)"file");
+  rocket_executor_submit_task(
+    executor, write_read_worker, (void*)"another_file");
+  rocket_executor_execute(executor);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+}
+
+/* Test case to verify that an engine can be created with the task running
+ * setup flags, falling back to what the kernel supports, and that an invalid
+ * configuration fails.
+ */
+TEST(Engine, SetupFlags) {
+  rocket_engine_config_t config;
+  rocket_engine_config_init(&config, queue_depth);
+  config.cq_entries = 4 * queue_depth;
+  config.flags = ROCKET_ENGINE_DEFER_TASKRUN | ROCKET_ENGINE_COOP_TASKRUN;
+
+  rocket_engine_t* engine = rocket_engine_create_ex(&config);
+  ASSERT_NE(engine, nullptr);
+
+  rocket_engine_config_t actual;
+  rocket_engine_get_config(engine, &actual);
+  EXPECT_EQ(actual.queue_depth, config.queue_depth);
+  EXPECT_EQ(actual.cq_entries, config.cq_entries);
+  // Flags can only be dropped, and deferred task running always comes with
+  // a single issuer.
+  EXPECT_EQ(actual.flags & ~(config.flags | ROCKET_ENGINE_SINGLE_ISSUER), 0);
+  if (actual.flags & ROCKET_ENGINE_DEFER_TASKRUN) {
+    EXPECT_TRUE(actual.flags & ROCKET_ENGINE_SINGLE_ISSUER);
+  }
+  rocket_engine_destroy(engine);
+
+  run_write_read_workers(&config);
+
+  // A completion queue smaller than the submission queue is invalid with or
+  // without the flags, so it fails instead of dropping them.
+  config.cq_entries = queue_depth / 2;
+  EXPECT_EQ(rocket_engine_create_ex(&config), nullptr);
+}
+
+/* Test case to verify that engines polling the submission queue work, alone
+ * and sharing the kernel workers of another engine.
+ */
+TEST(Engine, SqPoll) {
+  rocket_engine_config_t config;
+  rocket_engine_config_init(&config, queue_depth);
+  config.flags = ROCKET_ENGINE_SQPOLL;
+  config.sq_thread_idle_ms = 10;
+  run_write_read_workers(&config);
+
+  rocket_engine_t* shared = rocket_engine_create_ex(&config);
+  ASSERT_NE(shared, nullptr);
+  config.attach_engine = shared;
+  run_write_read_workers(&config);
+  rocket_engine_destroy(shared);
+}
+
+// Worker function receiving a message on a socket after its first receive
+// times out.
+static void* epoll_recv_worker(void* context) {
+  int sockfd = *(int*)context;
+  char buf[16];
+  rocket_fiber_set_io_timeout(10 * 1000 * 1000);
+  EXPECT_EQ(recv_await(sockfd, buf, sizeof(buf), 0), -ETIME);
+
+  rocket_fiber_set_io_timeout(0);
+  EXPECT_EQ(recv_await(sockfd, buf, sizeof(buf), MSG_WAITALL), sizeof(buf));
+  EXPECT_EQ(memcmp(buf, "0123456789abcdef", sizeof(buf)), 0);
+  return nullptr;
+}
+
+// Worker function sending a message on a socket in two parts.
+static void* epoll_send_worker(void* context) {
+  int sockfd = *(int*)context;
+  EXPECT_EQ(rocket_sleep_await(50 * 1000 * 1000), 0);
+  EXPECT_EQ(send_await(sockfd, "01234567", 8, 0), 8);
+  EXPECT_EQ(rocket_sleep_await(1000 * 1000), 0);
+  EXPECT_EQ(send_await(sockfd, "89abcdef", 8, 0), 8);
+  return nullptr;
+}
+
+/* Test case to verify that the epoll engine runs file requests, socket
+ * requests waiting for readiness, timeouts and sleeps.
+ */
+TEST(Engine, Epoll) {
+  rocket_engine_config_t config;
+  rocket_engine_config_init(&config, queue_depth);
+  config.backend = ROCKET_ENGINE_EPOLL;
+  run_write_read_workers(&config);
+
+  int sockfds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, sockfds), 0);
+  rocket_engine_t* engine = rocket_engine_create_ex(&config);
+  ASSERT_NE(engine, nullptr);
+  // Registered buffers are specific to io_uring.
+  int buf_index;
+  EXPECT_EQ(rocket_engine_register_buffers(engine, /*nr_buffers=*/4,
+                                           /*buffer_size=*/4096), -EOPNOTSUPP);
+  EXPECT_EQ(rocket_engine_alloc_buffer(engine, &buf_index), nullptr);
+  rocket_engine_free_buffer(engine, /*buf_index=*/0);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  rocket_executor_submit_task(executor, epoll_recv_worker, &sockfds[0]);
+  rocket_executor_submit_task(executor, epoll_send_worker, &sockfds[1]);
+  rocket_executor_execute(executor);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+  close(sockfds[0]);
+  close(sockfds[1]);
+}
+
+static bool offload_done;
+
+// Blocking call taking a while.
+static long slow_call(void* arg) {
+  usleep(50 * 1000);
+  return (intptr_t)arg;
+}
+
+static void* offload_worker(void* context) {
+  EXPECT_EQ(rocket_offload_await(slow_call, (void*)42), 42);
+  offload_done = true;
+  return nullptr;
+}
+
+// Worker function counting how often it runs while the slow call is running.
+static void* ticker_worker(void* context) {
+  int* ticks = (int*)context;
+  while (!offload_done) {
+    EXPECT_EQ(rocket_sleep_await(1000 * 1000), 0);
+    (*ticks)++;
+  }
+  return nullptr;
+}
+
+static void run_offload_workers(rocket_engine_backend_t backend) {
+  rocket_engine_config_t config;
+  rocket_engine_config_init(&config, queue_depth);
+  config.backend = backend;
+  rocket_engine_t* engine = rocket_engine_create_ex(&config);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  offload_done = false;
+  int ticks = 0;
+  rocket_executor_submit_task(executor, offload_worker, nullptr);
+  rocket_executor_submit_task(executor, ticker_worker, &ticks);
+  rocket_executor_execute(executor);
+  // The executor kept running other fibers during the blocking call.
+  EXPECT_GT(ticks, 1);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+}
+
+/* Test case to verify blocking calls run on worker threads without stalling
+ * other fibers, on both backends.
+ */
+TEST(Engine, Offload) {
+  run_offload_workers(ROCKET_ENGINE_IO_URING);
+  run_offload_workers(ROCKET_ENGINE_EPOLL);
+}
+
+static void* sleep_worker(void* context) {
+  EXPECT_EQ(rocket_sleep_await(1000 * 1000), 0);
+  (*(int*)context)++;
+  return nullptr;
+}
+
+typedef struct {
+  int fd;
+  int done;
+} null_write_context_t;
+
+static void* null_write_worker(void* context) {
+  null_write_context_t* null_write = (null_write_context_t*)context;
+  EXPECT_EQ(writeat_await(null_write->fd, "x", 1, 0), 1);
+  null_write->done++;
+  return nullptr;
+}
+
+/* Test case to verify that fibers wait for room in a submission queue much
+ * smaller than the number of requests in flight instead of failing, both
+ * when flushing the queue makes room and when completions overflowed the
+ * completion queue and the executor has to reap them first.
+ */
+TEST(Engine, SubmissionQueueFull) {
+  rocket_engine_t* engine = rocket_engine_create(/*queue_depth=*/2);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  const int nr_fibers = 64;
+  int done = 0;
+  for (int i = 0; i < nr_fibers; i++) {
+    rocket_executor_submit_task(executor, sleep_worker, &done);
+  }
+  rocket_executor_execute(executor);
+  EXPECT_EQ(done, nr_fibers);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+
+  // Writes to /dev/null complete during submission, so every flush of the
+  // queue adds completions nobody reaps until the fibers have all run, and
+  // the smallest completion queue overflows after two flushes.
+  rocket_engine_config_t config;
+  rocket_engine_config_init(&config, /*queue_depth=*/2);
+  config.cq_entries = 2;
+  engine = rocket_engine_create_ex(&config);
+  ASSERT_NE(engine, nullptr);
+  executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  null_write_context_t null_write = {open("/dev/null", O_WRONLY), 0};
+  ASSERT_GE(null_write.fd, 0);
+  for (int i = 0; i < nr_fibers; i++) {
+    rocket_executor_submit_task(executor, null_write_worker, &null_write);
+  }
+  rocket_executor_execute(executor);
+  EXPECT_EQ(null_write.done, nr_fibers);
+  rocket_engine_stats_t stats;
+  rocket_engine_get_stats(engine, &stats);
+  EXPECT_GT(stats.sq_waits, 0);
+
+  close(null_write.fd);
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+}
+
+typedef struct {
+  uint64_t duration_ns;
+  int count;
+} sleeps_context_t;
+
+static void* sleeps_worker(void* context) {
+  sleeps_context_t* sleeps = (sleeps_context_t*)context;
+  for (int i = 0; i < sleeps->count; i++) {
+    EXPECT_EQ(rocket_sleep_await(sleeps->duration_ns), 0);
+  }
+  return nullptr;
+}
+
+// Test case to verify how the busy-poll window adapts to the waits for
+// completions.
+TEST(Engine, BusyPollWindow) {
+  busy_poll_t poll;
+  busy_poll_init(&poll, /*busy_poll_us=*/1000);
+  EXPECT_EQ(poll.window_ns, 1000 * 1000);
+
+  // The window shrinks to about twice waits well within it.
+  for (int i = 0; i < 100; i++) {
+    busy_poll_update(&poll, 200 * 1000);
+  }
+  EXPECT_NEAR(poll.window_ns, 400 * 1000, 100);
+
+  // But not below an eighth of the configured window.
+  for (int i = 0; i < 100; i++) {
+    busy_poll_update(&poll, 0);
+  }
+  EXPECT_EQ(poll.window_ns, 125 * 1000);
+
+  // Waits close to the window keep it whole.
+  for (int i = 0; i < 100; i++) {
+    busy_poll_update(&poll, 800 * 1000);
+  }
+  EXPECT_EQ(poll.window_ns, 1000 * 1000);
+
+  // Completions arriving much later than the window aren't worth spinning
+  // for, until they come sooner again.
+  for (int i = 0; i < 100; i++) {
+    busy_poll_update(&poll, 10 * 1000 * 1000);
+  }
+  EXPECT_EQ(poll.window_ns, 0);
+  for (int i = 0; i < 100; i++) {
+    busy_poll_update(&poll, 200 * 1000);
+  }
+  EXPECT_NEAR(poll.window_ns, 400 * 1000, 100);
+}
+
+/* Test case to verify that an engine busy-polling for completions before
+ * sleeping completes requests arriving both within and after the window, and
+ * catches the former while spinning.
+ */
+TEST(Engine, BusyPoll) {
+  rocket_engine_config_t config;
+  rocket_engine_config_init(&config, queue_depth);
+  config.busy_poll_us = 50;
+  run_write_read_workers(&config);
+
+  rocket_engine_t* engine = rocket_engine_create_ex(&config);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  // Sleeps last much longer than the window.
+  int done = 0;
+  rocket_executor_submit_task(executor, sleep_worker, &done);
+  rocket_executor_submit_task(executor, sleep_worker, &done);
+  rocket_executor_execute(executor);
+  EXPECT_EQ(done, 2);
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+
+  config.busy_poll_us = 1000;
+  engine = rocket_engine_create_ex(&config);
+  ASSERT_NE(engine, nullptr);
+  executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+  rocket_engine_stats_t stats;
+  rocket_engine_get_stats(engine, &stats);
+  EXPECT_EQ(stats.busy_poll_window_ns, 1000 * 1000);
+
+  // Completions arriving well within the window are caught spinning.
+  sleeps_context_t short_sleeps = {100 * 1000, 20};
+  rocket_executor_submit_task(executor, sleeps_worker, &short_sleeps);
+  rocket_executor_execute(executor);
+  rocket_engine_get_stats(engine, &stats);
+  EXPECT_GT(stats.busy_poll_hits, 0);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+}
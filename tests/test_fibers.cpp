@@ -25,6 +25,7 @@
 
 #include <alloca.h>
 #include <pthread.h>
+#include <time.h>
 
 #include <rocket/rocket_engine.h>
 #include <rocket/rocket_executor.h>
@@ -136,6 +137,41 @@ TEST(Fibers, MaxStackGrowth) {
   test_max_stack_growth();
 }
 
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Worker function sleeping for the number of milliseconds in context.
+static void* sleep_worker(void* context) {
+  uint64_t duration_ns = (uintptr_t)context * 1000 * 1000;
+  uint64_t start = now_ns();
+  EXPECT_EQ(rocket_sleep_await(duration_ns), 0);
+  EXPECT_GE(now_ns() - start, duration_ns);
+  return nullptr;
+}
+
+// Test case to verify sleeping fibers don't block each other.
+TEST(Fibers, Sleep) {
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  ASSERT_NE(engine, nullptr);
+
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  uint64_t start = now_ns();
+  for (uintptr_t i = 0; i < 5; i++) {
+    rocket_executor_submit_task(executor, sleep_worker, (void*)(i * 20));
+  }
+  rocket_executor_execute(executor);
+  // The sleeps overlap.
+  EXPECT_LT(now_ns() - start, 1000 * 1000 * 1000ULL);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+}
+
 static void* worker_thread(void* context) {
   void (*test_func)(void) = (void (*)(void))context;
   test_func();
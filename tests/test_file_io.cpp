@@ -23,6 +23,10 @@
  * SOFTWARE.
  */
 
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
 #include <rocket/rocket_engine.h>
 #include <rocket/rocket_executor.h>
 #include <rocket/rocket_fiber.h>
@@ -114,3 +118,567 @@ TEST(FileIO, FileOpenWriteReadClose) {
   rocket_executor_destroy(executor);
   rocket_engine_destroy(engine);
 }
+
+/* Test case to verify that requests queued by more fibers than the submission
+ * queue can hold are still submitted and completed.
+ */
+TEST(FileIO, MoreFibersThanQueueDepth) {
+  rocket_engine_t* engine = rocket_engine_create(/*queue_depth=*/2);
+  EXPECT_NE(engine, nullptr);
+
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  EXPECT_NE(executor, nullptr);
+
+  char filenames[16][32];
+  for (int i = 0; i < 16; i++) {
+    snprintf(filenames[i], sizeof(filenames[i]), "batched_file%d", i);
+    rocket_executor_submit_task(
+      executor, file_open_write_read_close_worker, filenames[i]);
+  }
+  rocket_executor_execute(executor);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+}
+
+static void* file_direct_open_write_read_close_worker(void* context) {
+  const char* filename = (const char*)context;
+  int file_index = openat_direct_await(AT_FDCWD, filename, O_CREAT | O_RDWR,
+                                       0644, ROCKET_FILE_INDEX_ALLOC);
+  EXPECT_GE(file_index, 0);
+
+  const char write_buf[] = "pi ... ka ... pika pika ... pikachu!";
+  const int write_buf_size = sizeof(write_buf);
+
+  ssize_t nbytes =
+      writeat_direct_await(file_index, write_buf, write_buf_size, 0);
+  EXPECT_EQ(nbytes, write_buf_size);
+
+  char read_buf[write_buf_size];
+  nbytes = readat_direct_await(file_index, read_buf, write_buf_size, 0);
+  EXPECT_EQ(nbytes, write_buf_size);
+  EXPECT_EQ(memcmp(read_buf, write_buf, write_buf_size), 0);
+  EXPECT_EQ(close_direct_await(file_index), 0);
+  EXPECT_EQ(unlink(filename), 0);
+  return nullptr;
+}
+
+// Test case to verify file I/O through the fixed file table.
+TEST(FileIO, DirectFileOpenWriteReadClose) {
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  EXPECT_NE(engine, nullptr);
+  EXPECT_EQ(rocket_engine_register_files(engine, /*nr_files=*/4), 0);
+
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  EXPECT_NE(executor, nullptr);
+
+  rocket_executor_submit_task(
+    executor, file_direct_open_write_read_close_worker, (void*)"file");
+  rocket_executor_submit_task(
+    executor, file_direct_open_write_read_close_worker, (void*)"another_file");
+  rocket_executor_execute(executor);
+
+  rocket_executor_destroy(executor);
+  EXPECT_EQ(rocket_engine_unregister_files(engine), 0);
+  rocket_engine_destroy(engine);
+}
+
+static void* file_chain_worker(void* context) {
+  const char* filename = (const char*)context;
+  const char write_buf[] = "pi ... ka ... pika pika ... pikachu!";
+  const int write_buf_size = sizeof(write_buf);
+  char read_buf[write_buf_size];
+
+  rocket_chain_t* chain = rocket_chain_create(/*max_requests=*/4, 0);
+  EXPECT_NE(chain, nullptr);
+  EXPECT_EQ(rocket_chain_openat_direct(chain, AT_FDCWD, filename,
+                                       O_CREAT | O_RDWR, 0644, 0), 0);
+  EXPECT_EQ(rocket_chain_writeat_direct(chain, 0, write_buf, write_buf_size,
+                                        0), 1);
+  EXPECT_EQ(rocket_chain_readat_direct(chain, 0, read_buf, write_buf_size, 0),
+            2);
+  EXPECT_EQ(rocket_chain_close_direct(chain, 0), 3);
+  EXPECT_EQ(rocket_chain_close_direct(chain, 0), -ENOSPC);
+
+  EXPECT_EQ(rocket_chain_submit_await(chain), 0);
+  EXPECT_EQ(rocket_chain_result(chain, 0), 0);
+  EXPECT_EQ(rocket_chain_result(chain, 1), write_buf_size);
+  EXPECT_EQ(rocket_chain_result(chain, 2), write_buf_size);
+  EXPECT_EQ(rocket_chain_result(chain, 3), 0);
+  EXPECT_EQ(memcmp(read_buf, write_buf, write_buf_size), 0);
+  EXPECT_EQ(unlink(filename), 0);
+
+  // Opening the now missing file fails and cancels the rest of the chain.
+  rocket_chain_reset(chain);
+  rocket_chain_openat_direct(chain, AT_FDCWD, filename, O_RDONLY, 0, 0);
+  rocket_chain_readat_direct(chain, 0, read_buf, write_buf_size, 0);
+  rocket_chain_close_direct(chain, 0);
+  EXPECT_EQ(rocket_chain_submit_await(chain), -ENOENT);
+  EXPECT_EQ(rocket_chain_result(chain, 1), -ECANCELED);
+  EXPECT_EQ(rocket_chain_result(chain, 2), -ECANCELED);
+
+  rocket_chain_destroy(chain);
+  return nullptr;
+}
+
+// Test case to verify linked requests complete as one chain.
+TEST(FileIO, LinkedChain) {
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  EXPECT_NE(engine, nullptr);
+  EXPECT_EQ(rocket_engine_register_files(engine, /*nr_files=*/1), 0);
+
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  EXPECT_NE(executor, nullptr);
+
+  rocket_executor_submit_task(executor, file_chain_worker, (void*)"file");
+  rocket_executor_execute(executor);
+
+  rocket_executor_destroy(executor);
+  EXPECT_EQ(rocket_engine_unregister_files(engine), 0);
+  rocket_engine_destroy(engine);
+}
+
+typedef struct {
+  rocket_engine_t* engine;
+  const char* filename;
+} fixed_buffer_context_t;
+
+static void* file_fixed_buffer_write_read_worker(void* context) {
+  fixed_buffer_context_t* fixed_context = (fixed_buffer_context_t*)context;
+  int write_index, read_index;
+  char* write_buf =
+      (char*)rocket_engine_alloc_buffer(fixed_context->engine, &write_index);
+  char* read_buf =
+      (char*)rocket_engine_alloc_buffer(fixed_context->engine, &read_index);
+  EXPECT_NE(write_buf, nullptr);
+  EXPECT_NE(read_buf, nullptr);
+
+  int fd = openat_await(AT_FDCWD, fixed_context->filename, O_CREAT | O_RDWR,
+                        0644);
+  EXPECT_GT(fd, 0);
+
+  const size_t size = 4096;
+  memset(write_buf, 'r', size);
+  EXPECT_EQ(writeat_fixed_await(fd, write_buf, size, 0, write_index), size);
+  EXPECT_EQ(readat_fixed_await(fd, read_buf, size, 0, read_index), size);
+  EXPECT_EQ(memcmp(read_buf, write_buf, size), 0);
+
+  EXPECT_EQ(close_await(fd), 0);
+  EXPECT_EQ(unlink(fixed_context->filename), 0);
+  rocket_engine_free_buffer(fixed_context->engine, write_index);
+  rocket_engine_free_buffer(fixed_context->engine, read_index);
+  return nullptr;
+}
+
+// Test case to verify file I/O with registered buffers.
+TEST(FileIO, FixedBufferWriteRead) {
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  EXPECT_NE(engine, nullptr);
+  // Sizes wrapping around are rejected rather than allocated short.
+  EXPECT_EQ(rocket_engine_register_buffers(engine, /*nr_buffers=*/2,
+                                           SIZE_MAX / 2 + 1), -EINVAL);
+  EXPECT_EQ(rocket_engine_register_buffers(engine, /*nr_buffers=*/4,
+                                           /*buffer_size=*/4096), 0);
+
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  EXPECT_NE(executor, nullptr);
+
+  fixed_buffer_context_t contexts[] = {
+    {engine, "file"},
+    {engine, "another_file"},
+  };
+  rocket_executor_submit_task(
+    executor, file_fixed_buffer_write_read_worker, &contexts[0]);
+  rocket_executor_submit_task(
+    executor, file_fixed_buffer_write_read_worker, &contexts[1]);
+  rocket_executor_execute(executor);
+
+  // All buffers are back after the workers are done.
+  int buf_indices[4];
+  for (int& buf_index : buf_indices) {
+    EXPECT_NE(rocket_engine_alloc_buffer(engine, &buf_index), nullptr);
+  }
+  int buf_index;
+  EXPECT_EQ(rocket_engine_alloc_buffer(engine, &buf_index), nullptr);
+  for (int buf_index : buf_indices) {
+    rocket_engine_free_buffer(engine, buf_index);
+  }
+  EXPECT_EQ(rocket_engine_unregister_buffers(engine), 0);
+  EXPECT_EQ(rocket_engine_alloc_buffer(engine, &buf_index), nullptr);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+}
+
+static void* file_writev_readv_worker(void* context) {
+  const char* filename = (const char*)context;
+  int fd = openat_await(AT_FDCWD, filename, O_CREAT | O_RDWR, 0644);
+  EXPECT_GT(fd, 0);
+
+  char header[] = "header:";
+  char payload[] = "pika pika";
+  struct iovec write_iov[] = {
+    {header, sizeof(header)},
+    {payload, sizeof(payload)},
+  };
+  EXPECT_EQ(writev_await(fd, write_iov, 2, 0),
+            sizeof(header) + sizeof(payload));
+
+  char read_header[sizeof(header)];
+  char read_payload[sizeof(payload)];
+  struct iovec read_iov[] = {
+    {read_header, sizeof(read_header)},
+    {read_payload, sizeof(read_payload)},
+  };
+  EXPECT_EQ(readv_await(fd, read_iov, 2, 0),
+            sizeof(header) + sizeof(payload));
+  EXPECT_EQ(memcmp(read_header, header, sizeof(header)), 0);
+  EXPECT_EQ(memcmp(read_payload, payload, sizeof(payload)), 0);
+
+  EXPECT_EQ(close_await(fd), 0);
+  EXPECT_EQ(unlink(filename), 0);
+  return nullptr;
+}
+
+// Test case to verify vectored file I/O.
+TEST(FileIO, WritevReadv) {
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  EXPECT_NE(engine, nullptr);
+
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  EXPECT_NE(executor, nullptr);
+
+  rocket_executor_submit_task(
+    executor, file_writev_readv_worker, (void*)"file");
+  rocket_executor_submit_task(
+    executor, file_writev_readv_worker, (void*)"another_file");
+  rocket_executor_execute(executor);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+}
+
+static long offloaded_call(void*) {
+  return 0;
+}
+
+static void* polled_direct_io_worker(void* context) {
+  int fd = (intptr_t)context;
+  // Polled engines can't wait for worker threads.
+  EXPECT_EQ(rocket_offload_await(offloaded_call, nullptr), -EOPNOTSUPP);
+
+  char* buf = (char*)rocket_direct_io_alloc(100);
+  EXPECT_NE(buf, nullptr);
+  if (buf == nullptr) {
+    return nullptr;
+  }
+  EXPECT_EQ((uintptr_t)buf % ROCKET_DIRECT_IO_ALIGNMENT, 0);
+
+  // Misaligned requests are rejected before reaching the device.
+  EXPECT_EQ(writeat_await(fd, buf + 1, ROCKET_DIRECT_IO_ALIGNMENT, 0),
+            -EINVAL);
+  EXPECT_EQ(writeat_await(fd, buf, 100, 0), -EINVAL);
+  EXPECT_EQ(readat_await(fd, buf, ROCKET_DIRECT_IO_ALIGNMENT, 1), -EINVAL);
+
+  memset(buf, 'r', ROCKET_DIRECT_IO_ALIGNMENT);
+  ssize_t nbytes = writeat_await(fd, buf, ROCKET_DIRECT_IO_ALIGNMENT, 0);
+  // Devices without poll queues don't support polled I/O.
+  if (nbytes != -EOPNOTSUPP) {
+    EXPECT_EQ(nbytes, ROCKET_DIRECT_IO_ALIGNMENT);
+    memset(buf, 0, ROCKET_DIRECT_IO_ALIGNMENT);
+    EXPECT_EQ(readat_await(fd, buf, ROCKET_DIRECT_IO_ALIGNMENT, 0),
+              ROCKET_DIRECT_IO_ALIGNMENT);
+    EXPECT_EQ(buf[ROCKET_DIRECT_IO_ALIGNMENT - 1], 'r');
+  }
+
+  rocket_direct_io_free(buf);
+  return nullptr;
+}
+
+// Test case to verify direct I/O on an engine polling for completions.
+TEST(FileIO, PolledDirectIO) {
+  int fd = open("direct_file", O_CREAT | O_RDWR | O_DIRECT, 0644);
+  if (fd < 0) {
+    // The file system doesn't support direct I/O, e.g. tmpfs.
+    EXPECT_EQ(errno, EINVAL);
+    GTEST_SKIP();
+  }
+
+  rocket_engine_config_t config;
+  rocket_engine_config_init(&config, queue_depth);
+  config.flags = ROCKET_ENGINE_IOPOLL;
+  rocket_engine_t* engine = rocket_engine_create_ex(&config);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  rocket_executor_submit_task(
+    executor, polled_direct_io_worker, (void*)(intptr_t)fd);
+  rocket_executor_execute(executor);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+  close(fd);
+  EXPECT_EQ(unlink("direct_file"), 0);
+}
+
+static const size_t record_size = 16;
+
+typedef struct {
+  rocket_log_t* log;
+  char record[record_size];
+  off_t offset;
+} log_append_context_t;
+
+static void* log_append_worker(void* context) {
+  log_append_context_t* append = (log_append_context_t*)context;
+  append->offset =
+      rocket_log_append_await(append->log, append->record, record_size);
+  return nullptr;
+}
+
+static void* log_canceled_worker(void* context) {
+  log_append_context_t* append = (log_append_context_t*)context;
+  // Canceled while leading the flush, the record is still made durable.
+  append->offset =
+      rocket_log_append_await(append->log, append->record, record_size);
+  EXPECT_EQ(rocket_sleep_await(1000), -ECANCELED);
+  return nullptr;
+}
+
+static void* log_cancel_worker(void* context) {
+  // The first appender yielded to lead the flush and hasn't started it yet.
+  rocket_fiber_cancel((rocket_fiber_t*)context);
+  return nullptr;
+}
+
+static void* sync_worker(void* context) {
+  int fd = (intptr_t)context;
+  EXPECT_EQ(writeat_await(fd, "durable", 7, 0), 7);
+  EXPECT_EQ(sync_file_range_await(fd, 0, 7, SYNC_FILE_RANGE_WRITE), 0);
+  EXPECT_EQ(fdatasync_await(fd), 0);
+  EXPECT_EQ(fsync_await(fd), 0);
+  return nullptr;
+}
+
+/* Test case to verify that records appended by many fibers to a log are all
+ * written once, at the offsets they are acknowledged with, and that files
+ * can be synced.
+ */
+TEST(FileIO, GroupCommit) {
+  int fd = open("log_file", O_CREAT | O_RDWR | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  rocket_executor_submit_task(executor, sync_worker, (void*)(intptr_t)fd);
+  rocket_executor_execute(executor);
+
+  rocket_log_t* log = rocket_log_create(fd, /*offset=*/0, ROCKET_LOG_DATASYNC);
+  ASSERT_NE(log, nullptr);
+  const size_t nr_appends = 100;
+  log_append_context_t appends[nr_appends] = {};
+  for (size_t i = 0; i < nr_appends; i++) {
+    appends[i].log = log;
+    snprintf(appends[i].record, record_size, "record %zu", i);
+    rocket_executor_submit_task(executor, log_append_worker, &appends[i]);
+  }
+  rocket_executor_execute(executor);
+  rocket_log_destroy(log);
+
+  bool written[nr_appends] = {};
+  for (size_t i = 0; i < nr_appends; i++) {
+    ASSERT_GE(appends[i].offset, 0);
+    ASSERT_EQ(appends[i].offset % record_size, 0);
+    size_t slot = appends[i].offset / record_size;
+    ASSERT_LT(slot, nr_appends);
+    EXPECT_FALSE(written[slot]);
+    written[slot] = true;
+
+    char record[record_size];
+    EXPECT_EQ(pread(fd, record, record_size, appends[i].offset),
+              record_size);
+    EXPECT_EQ(memcmp(record, appends[i].record, record_size), 0);
+  }
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+  close(fd);
+  EXPECT_EQ(unlink("log_file"), 0);
+}
+
+/* Test case to verify that canceling a fiber appending to a log fails
+ * neither the records of the other fibers nor later appends.
+ */
+TEST(FileIO, GroupCommitCancel) {
+  int fd = open("log_file", O_CREAT | O_RDWR | O_TRUNC, 0644);
+  ASSERT_GE(fd, 0);
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+  rocket_log_t* log = rocket_log_create(fd, /*offset=*/0, /*flags=*/0);
+  ASSERT_NE(log, nullptr);
+
+  const size_t nr_appends = 8;
+  log_append_context_t appends[nr_appends] = {};
+  for (size_t i = 0; i < nr_appends; i++) {
+    appends[i].log = log;
+    snprintf(appends[i].record, record_size, "record %zu", i);
+  }
+  rocket_fiber_t* leader =
+    rocket_executor_submit_task(executor, log_canceled_worker, &appends[0]);
+  ASSERT_NE(leader, nullptr);
+  rocket_executor_submit_task(executor, log_cancel_worker, leader);
+  for (size_t i = 1; i < nr_appends - 1; i++) {
+    rocket_executor_submit_task(executor, log_append_worker, &appends[i]);
+  }
+  rocket_executor_execute(executor);
+  rocket_executor_submit_task(
+    executor, log_append_worker, &appends[nr_appends - 1]);
+  rocket_executor_execute(executor);
+  rocket_log_destroy(log);
+
+  for (size_t i = 0; i < nr_appends; i++) {
+    EXPECT_GE(appends[i].offset, 0);
+  }
+  EXPECT_EQ(appends[nr_appends - 1].offset,
+            (off_t)((nr_appends - 1) * record_size));
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+  close(fd);
+  EXPECT_EQ(unlink("log_file"), 0);
+}
+
+static void* metadata_worker(void*) {
+  EXPECT_EQ(mkdirat_await(AT_FDCWD, "metadata_dir", 0755), 0);
+  EXPECT_EQ(mkdirat_await(AT_FDCWD, "metadata_dir", 0755), -EEXIST);
+  int fd = openat_await(AT_FDCWD, "metadata_dir/file", O_CREAT | O_RDWR, 0644);
+  EXPECT_GE(fd, 0);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct statx stx;
+  EXPECT_EQ(fallocate_await(fd, /*mode=*/0, /*offset=*/0, /*len=*/8192), 0);
+  EXPECT_EQ(statx_await(AT_FDCWD, "metadata_dir/file", 0, STATX_SIZE, &stx),
+            0);
+  EXPECT_EQ(stx.stx_size, 8192);
+  EXPECT_EQ(ftruncate_await(fd, 100), 0);
+  int read_fd = openat_await(AT_FDCWD, "metadata_dir/file", O_RDONLY, 0);
+  EXPECT_GE(read_fd, 0);
+  EXPECT_EQ(ftruncate_await(read_fd, 0), -EINVAL);
+  EXPECT_EQ(close_await(read_fd), 0);
+  EXPECT_EQ(statx_await(fd, "", AT_EMPTY_PATH, STATX_SIZE, &stx), 0);
+  EXPECT_EQ(stx.stx_size, 100);
+  EXPECT_EQ(close_await(fd), 0);
+
+  fd = openat_await(AT_FDCWD, "metadata_dir/other", O_CREAT | O_RDWR, 0644);
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(close_await(fd), 0);
+  EXPECT_EQ(renameat_await(AT_FDCWD, "metadata_dir/file", AT_FDCWD,
+                           "metadata_dir/other", RENAME_NOREPLACE),
+            -EEXIST);
+  EXPECT_EQ(renameat_await(AT_FDCWD, "metadata_dir/file", AT_FDCWD,
+                           "metadata_dir/renamed", /*flags=*/0),
+            0);
+  EXPECT_EQ(statx_await(AT_FDCWD, "metadata_dir/file", 0, STATX_SIZE, &stx),
+            -ENOENT);
+  EXPECT_EQ(statx_await(AT_FDCWD, "metadata_dir/renamed", 0, STATX_SIZE,
+                        &stx),
+            0);
+  EXPECT_EQ(stx.stx_size, 100);
+
+  EXPECT_EQ(unlinkat_await(AT_FDCWD, "metadata_dir", AT_REMOVEDIR),
+            -ENOTEMPTY);
+  EXPECT_EQ(unlinkat_await(AT_FDCWD, "metadata_dir/renamed", 0), 0);
+  EXPECT_EQ(unlinkat_await(AT_FDCWD, "metadata_dir/other", 0), 0);
+  EXPECT_EQ(unlinkat_await(AT_FDCWD, "metadata_dir", AT_REMOVEDIR), 0);
+  return nullptr;
+}
+
+/* Test case to verify that files and directories can be created, resized,
+ * inspected, renamed and removed on both backends.
+ */
+TEST(FileIO, Metadata) {
+  rocket_engine_backend_t backends[] = {
+    ROCKET_ENGINE_IO_URING, ROCKET_ENGINE_EPOLL};
+  for (rocket_engine_backend_t backend : backends) {
+    rocket_engine_config_t config;
+    rocket_engine_config_init(&config, queue_depth);
+    config.backend = backend;
+    rocket_engine_t* engine = rocket_engine_create_ex(&config);
+    ASSERT_NE(engine, nullptr);
+    rocket_executor_t* executor = rocket_executor_create(engine);
+    ASSERT_NE(executor, nullptr);
+
+    rocket_executor_submit_task(executor, metadata_worker, nullptr);
+    rocket_executor_execute(executor);
+
+    rocket_executor_destroy(executor);
+    rocket_engine_destroy(engine);
+  }
+}
+
+static void* prefetch_worker(void*) {
+  int fd = openat_await(AT_FDCWD, "prefetch_file", O_CREAT | O_RDWR, 0644);
+  EXPECT_GE(fd, 0);
+  if (fd < 0) {
+    return nullptr;
+  }
+  // Both buffers live on the fiber stack.
+  const size_t file_size = 8 * 1024;
+  char write_buf[file_size];
+  for (size_t i = 0; i < file_size; i++) {
+    write_buf[i] = 'a' + i % 26;
+  }
+  EXPECT_EQ(writeat_await(fd, write_buf, file_size, /*offset=*/0), file_size);
+
+  EXPECT_EQ(fadvise_await(fd, 0, file_size, POSIX_FADV_SEQUENTIAL), 0);
+  EXPECT_EQ(rocket_prefetch(fd, 0, file_size), 0);
+  // Ranges beyond 32 bits of length are hinted too.
+  const off_t large_len = 5LL << 30;
+  EXPECT_EQ(fadvise_await(fd, 0, large_len, POSIX_FADV_WILLNEED), 0);
+  EXPECT_EQ(rocket_prefetch(fd, 0, large_len), 0);
+  char read_buf[file_size];
+  EXPECT_EQ(readat_await(fd, read_buf, file_size, /*offset=*/0), file_size);
+  EXPECT_EQ(memcmp(read_buf, write_buf, file_size), 0);
+
+  void* addr = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+  EXPECT_NE(addr, MAP_FAILED);
+  if (addr != MAP_FAILED) {
+    EXPECT_EQ(madvise_await(addr, file_size, MADV_WILLNEED), 0);
+    EXPECT_EQ(memcmp(addr, write_buf, file_size), 0);
+    munmap(addr, file_size);
+  }
+
+  EXPECT_EQ(close_await(fd), 0);
+  EXPECT_EQ(unlink("prefetch_file"), 0);
+  return nullptr;
+}
+
+/* Test case to verify that access pattern hints and prefetches are issued on
+ * both backends without changing what is read.
+ */
+TEST(FileIO, Prefetch) {
+  rocket_engine_backend_t backends[] = {
+    ROCKET_ENGINE_IO_URING, ROCKET_ENGINE_EPOLL};
+  for (rocket_engine_backend_t backend : backends) {
+    rocket_engine_config_t config;
+    rocket_engine_config_init(&config, queue_depth);
+    config.backend = backend;
+    rocket_engine_t* engine = rocket_engine_create_ex(&config);
+    ASSERT_NE(engine, nullptr);
+    rocket_executor_t* executor = rocket_executor_create(engine);
+    ASSERT_NE(executor, nullptr);
+
+    rocket_executor_submit_task(executor, prefetch_worker, nullptr);
+    rocket_executor_execute(executor);
+
+    rocket_executor_destroy(executor);
+    rocket_engine_destroy(engine);
+  }
+}
@@ -0,0 +1,899 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2022 Andrew Rogers <andrurogerz@gmail.com>, Hechao Li
+ * <hechaol@outlook.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/utsname.h>
+
+#include <vector>
+
+#include <rocket/rocket_engine.h>
+#include <rocket/rocket_executor.h>
+#include <rocket/rocket_fiber.h>
+
+#include <gtest/gtest.h>
+
+static const size_t queue_depth = 10;
+static const char message[] = "pi ... ka ... pika pika ... pikachu!";
+
+// Fixed file slots of the two ends of a socket pair.
+static const int sender_index = 0;
+static const int receiver_index = 1;
+
+static void* direct_send_worker(void* context) {
+  ssize_t nbytes =
+      send_direct_await(sender_index, message, sizeof(message), /*flags=*/0);
+  EXPECT_EQ(nbytes, sizeof(message));
+  return nullptr;
+}
+
+static void* direct_recv_worker(void* context) {
+  char buf[sizeof(message)];
+  ssize_t nbytes =
+      recv_direct_await(receiver_index, buf, sizeof(buf), MSG_WAITALL);
+  EXPECT_EQ(nbytes, sizeof(message));
+  EXPECT_EQ(memcmp(buf, message, sizeof(message)), 0);
+  return nullptr;
+}
+
+// Test case to verify socket I/O through the fixed file table.
+TEST(SocketIO, DirectSendRecv) {
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  ASSERT_NE(engine, nullptr);
+  ASSERT_EQ(rocket_engine_register_files(engine, /*nr_files=*/2), 0);
+  ASSERT_EQ(rocket_engine_update_file(engine, sender_index, fds[0]), 0);
+  ASSERT_EQ(rocket_engine_update_file(engine, receiver_index, fds[1]), 0);
+  // The fixed file table holds its own references.
+  close(fds[0]);
+  close(fds[1]);
+
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  rocket_executor_submit_task(executor, direct_recv_worker, nullptr);
+  rocket_executor_submit_task(executor, direct_send_worker, nullptr);
+  rocket_executor_execute(executor);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+}
+
+typedef struct {
+  int sockfd;
+  rocket_buf_ring_t* ring;
+  size_t total;
+} buf_ring_context_t;
+
+static const size_t message_count = 8;
+
+static void* message_sender(void* context) {
+  buf_ring_context_t* ring_context = (buf_ring_context_t*)context;
+  for (size_t i = 0; i < message_count; i++) {
+    ssize_t nbytes =
+        send_await(ring_context->sockfd, message, sizeof(message), 0);
+    EXPECT_EQ(nbytes, sizeof(message));
+    rocket_fiber_yield();
+  }
+  EXPECT_EQ(shutdown(ring_context->sockfd, SHUT_WR), 0);
+  return nullptr;
+}
+
+static void* select_receiver(void* context) {
+  buf_ring_context_t* ring_context = (buf_ring_context_t*)context;
+  rocket_buf_t buf;
+  ssize_t nbytes;
+  while ((nbytes = recv_select_await(ring_context->sockfd, ring_context->ring,
+                                     0, &buf)) > 0) {
+    EXPECT_EQ(buf.len, nbytes);
+    ring_context->total += nbytes;
+    rocket_buf_ring_release(ring_context->ring, &buf);
+  }
+  EXPECT_EQ(nbytes, 0);
+  return nullptr;
+}
+
+static void stream_receive_all(buf_ring_context_t* ring_context) {
+  rocket_recv_stream_t* stream =
+      rocket_recv_stream_create(ring_context->sockfd, ring_context->ring, 0);
+  EXPECT_NE(stream, nullptr);
+
+  rocket_buf_t buf;
+  ssize_t nbytes;
+  while ((nbytes = recv_stream_await(stream, &buf)) != 0) {
+    // Data arriving faster than it's consumed can exhaust the ring, which
+    // pauses the stream until buffers are released.
+    if (nbytes == -ENOBUFS) {
+      continue;
+    }
+    ASSERT_GT(nbytes, 0);
+    EXPECT_EQ(buf.len, nbytes);
+    ring_context->total += nbytes;
+    rocket_buf_ring_release(ring_context->ring, &buf);
+  }
+  EXPECT_EQ(rocket_recv_stream_close_await(stream), 0);
+}
+
+static void* stream_receiver(void* context) {
+  stream_receive_all((buf_ring_context_t*)context);
+  return nullptr;
+}
+
+// Send messages through a socket pair and receive them with receiver.
+static void test_buf_ring_receive(rocket_task_func_t receiver) {
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  ASSERT_NE(engine, nullptr);
+  rocket_buf_ring_t* ring = rocket_buf_ring_create(
+      engine, /*bgid=*/0, /*nr_buffers=*/4, /*buffer_size=*/64);
+  ASSERT_NE(ring, nullptr);
+
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  buf_ring_context_t sender_context = {fds[0], ring, 0};
+  buf_ring_context_t receiver_context = {fds[1], ring, 0};
+  rocket_executor_submit_task(executor, receiver, &receiver_context);
+  rocket_executor_submit_task(executor, message_sender, &sender_context);
+  rocket_executor_execute(executor);
+
+  EXPECT_EQ(receiver_context.total, message_count * sizeof(message));
+
+  rocket_executor_destroy(executor);
+  rocket_buf_ring_destroy(ring);
+  rocket_engine_destroy(engine);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// Test case to verify receiving into buffers picked from a buffer ring.
+TEST(SocketIO, BufRingRecvSelect) {
+  test_buf_ring_receive(select_receiver);
+}
+
+// Test case to verify receiving with a multishot receive stream.
+TEST(SocketIO, BufRingRecvStream) {
+  test_buf_ring_receive(stream_receiver);
+}
+
+// Create a TCP socket listening on a loopback port. Stores the address in addr.
+static int listen_on_loopback(struct sockaddr_in* addr) {
+  int listenfd = socket(AF_INET, SOCK_STREAM, 0);
+  EXPECT_GE(listenfd, 0);
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr->sin_port = 0;
+  socklen_t addrlen = sizeof(*addr);
+  EXPECT_EQ(bind(listenfd, (struct sockaddr*)addr, addrlen), 0);
+  EXPECT_EQ(listen(listenfd, 16), 0);
+  EXPECT_EQ(getsockname(listenfd, (struct sockaddr*)addr, &addrlen), 0);
+  return listenfd;
+}
+
+typedef struct {
+  int listenfd;
+  struct sockaddr_in addr;
+  size_t clients;
+  size_t served;
+} accept_context_t;
+
+// Only one accept test runs at a time.
+static accept_context_t accept_context;
+
+// Task spawned per accepted connection. Echoes a single message.
+static void* echo_once(void* context) {
+  int fd = (intptr_t)context;
+  char buf[sizeof(message)];
+  EXPECT_EQ(recv_await(fd, buf, sizeof(buf), MSG_WAITALL), sizeof(buf));
+  EXPECT_EQ(send_await(fd, buf, sizeof(buf), 0), sizeof(buf));
+  EXPECT_EQ(close_await(fd), 0);
+  if (++accept_context.served == accept_context.clients) {
+    // Stop accepting.
+    EXPECT_EQ(shutdown(accept_context.listenfd, SHUT_RDWR), 0);
+  }
+  return nullptr;
+}
+
+static void* multishot_acceptor(void* context) {
+  int ret = accept_multishot_await(accept_context.listenfd, echo_once, 0);
+  EXPECT_LT(ret, 0);
+  return nullptr;
+}
+
+static void* echo_client(void* context) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(connect(fd, (struct sockaddr*)&accept_context.addr,
+                    sizeof(accept_context.addr)), 0);
+  EXPECT_EQ(send_await(fd, message, sizeof(message), 0), sizeof(message));
+  char buf[sizeof(message)];
+  EXPECT_EQ(recv_await(fd, buf, sizeof(buf), MSG_WAITALL), sizeof(buf));
+  EXPECT_EQ(memcmp(buf, message, sizeof(message)), 0);
+  close(fd);
+  return nullptr;
+}
+
+// Test case to verify a multishot accept spawns a fiber per connection.
+TEST(SocketIO, MultishotAccept) {
+  accept_context.listenfd = listen_on_loopback(&accept_context.addr);
+  accept_context.clients = 4;
+  accept_context.served = 0;
+
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  rocket_executor_submit_task(executor, multishot_acceptor, nullptr);
+  for (size_t i = 0; i < accept_context.clients; i++) {
+    rocket_executor_submit_task(executor, echo_client, nullptr);
+  }
+  rocket_executor_execute(executor);
+
+  EXPECT_EQ(accept_context.served, accept_context.clients);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+  close(accept_context.listenfd);
+}
+
+// Ancillary data buffer holding a single file descriptor.
+typedef union {
+  char buf[CMSG_SPACE(sizeof(int))];
+  struct cmsghdr align;
+} fd_cmsg_t;
+
+static void* sendmsg_worker(void* context) {
+  int sockfd = (intptr_t)context;
+  char header[] = "fd:";
+  struct iovec iov[] = {
+    {header, sizeof(header)},
+    {(void*)message, sizeof(message)},
+  };
+  fd_cmsg_t control;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+  int passed_fd = STDIN_FILENO;
+  memcpy(CMSG_DATA(cmsg), &passed_fd, sizeof(int));
+
+  EXPECT_EQ(sendmsg_await(sockfd, &msg, 0), sizeof(header) + sizeof(message));
+  return nullptr;
+}
+
+static void* recvmsg_worker(void* context) {
+  int sockfd = (intptr_t)context;
+  char header[4];
+  char payload[sizeof(message)];
+  struct iovec iov[] = {
+    {header, sizeof(header)},
+    {payload, sizeof(payload)},
+  };
+  fd_cmsg_t control;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  EXPECT_EQ(recvmsg_await(sockfd, &msg, MSG_WAITALL),
+            sizeof(header) + sizeof(payload));
+  EXPECT_EQ(memcmp(header, "fd:", sizeof(header)), 0);
+  EXPECT_EQ(memcmp(payload, message, sizeof(message)), 0);
+
+  struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  EXPECT_NE(cmsg, nullptr);
+  if (cmsg != nullptr) {
+    EXPECT_EQ(cmsg->cmsg_type, SCM_RIGHTS);
+    int received_fd;
+    memcpy(&received_fd, CMSG_DATA(cmsg), sizeof(int));
+    EXPECT_GE(received_fd, 0);
+    close(received_fd);
+  }
+  return nullptr;
+}
+
+// Test case to verify scatter/gather messages with ancillary data.
+TEST(SocketIO, SendmsgRecvmsg) {
+  int fds[2];
+  ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  rocket_executor_submit_task(
+    executor, recvmsg_worker, (void*)(intptr_t)fds[1]);
+  rocket_executor_submit_task(
+    executor, sendmsg_worker, (void*)(intptr_t)fds[0]);
+  rocket_executor_execute(executor);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// Create a pair of connected TCP sockets over loopback.
+static void tcp_socket_pair(int fds[2]) {
+  struct sockaddr_in addr;
+  int listenfd = listen_on_loopback(&addr);
+  fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+  EXPECT_GE(fds[0], 0);
+  EXPECT_EQ(connect(fds[0], (struct sockaddr*)&addr, sizeof(addr)), 0);
+  fds[1] = accept(listenfd, nullptr, nullptr);
+  EXPECT_GE(fds[1], 0);
+  close(listenfd);
+}
+
+typedef struct {
+  int sockfd;
+  bool released;
+} send_zc_context_t;
+
+static void release_zc_buffer(void* context) {
+  ((send_zc_context_t*)context)->released = true;
+}
+
+static void* send_zc_worker(void* context) {
+  send_zc_context_t* zc_context = (send_zc_context_t*)context;
+  ssize_t nbytes = send_zc_await(zc_context->sockfd, message, sizeof(message),
+                                 0, release_zc_buffer, zc_context);
+  // Kernels before 6.0 don't support zero-copy send.
+  if (nbytes == -EINVAL) {
+    EXPECT_TRUE(zc_context->released);
+    EXPECT_EQ(shutdown(zc_context->sockfd, SHUT_WR), 0);
+    return nullptr;
+  }
+  EXPECT_EQ(nbytes, sizeof(message));
+  return nullptr;
+}
+
+static void* recv_message_worker(void* context) {
+  int sockfd = (intptr_t)context;
+  char buf[sizeof(message)];
+  ssize_t nbytes = recv_await(sockfd, buf, sizeof(buf), MSG_WAITALL);
+  if (nbytes > 0) {
+    EXPECT_EQ(nbytes, sizeof(message));
+    EXPECT_EQ(memcmp(buf, message, sizeof(message)), 0);
+  }
+  return nullptr;
+}
+
+/* Test case to verify zero-copy sends deliver data and release the buffer
+ * once the kernel is done with it.
+ */
+TEST(SocketIO, SendZeroCopy) {
+  int fds[2];
+  tcp_socket_pair(fds);
+
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  send_zc_context_t zc_context = {fds[0], false};
+  rocket_executor_submit_task(
+    executor, recv_message_worker, (void*)(intptr_t)fds[1]);
+  rocket_executor_submit_task(executor, send_zc_worker, &zc_context);
+  rocket_executor_execute(executor);
+
+  // The executor keeps running until the buffer is released.
+  EXPECT_TRUE(zc_context.released);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+static void* send_zc_timeout_worker(void* context) {
+  send_zc_context_t* zc_context = (send_zc_context_t*)context;
+  // Fill up the socket buffer so that the send can't complete.
+  char buf[4096] = {};
+  while (send(zc_context->sockfd, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+  }
+  rocket_fiber_set_io_timeout(10 * 1000 * 1000);
+  ssize_t nbytes = send_zc_await(zc_context->sockfd, message, sizeof(message),
+                                 0, release_zc_buffer, zc_context);
+  // Kernels before 6.0 don't support zero-copy send.
+  if (nbytes != -EINVAL) {
+    EXPECT_EQ(nbytes, -ETIME);
+  }
+  return nullptr;
+}
+
+/* Test case to verify that zero-copy sends time out with the I/O timeout of
+ * the fiber and still release the buffer.
+ */
+TEST(SocketIO, SendZeroCopyTimeout) {
+  int fds[2];
+  tcp_socket_pair(fds);
+
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  send_zc_context_t zc_context = {fds[0], false};
+  rocket_executor_submit_task(executor, send_zc_timeout_worker, &zc_context);
+  rocket_executor_execute(executor);
+  EXPECT_TRUE(zc_context.released);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+typedef struct {
+  int sockfd;
+  int fd;
+  size_t len;
+} sendfile_context_t;
+
+static void* sendfile_worker(void* context) {
+  sendfile_context_t* sendfile_context = (sendfile_context_t*)context;
+  // Sending from the middle of the file up to past its end stops at the end.
+  ssize_t nbytes = sendfile_await(sendfile_context->sockfd,
+                                  sendfile_context->fd, /*offset=*/1,
+                                  sendfile_context->len);
+  EXPECT_EQ(nbytes, sendfile_context->len - 1);
+  EXPECT_EQ(shutdown(sendfile_context->sockfd, SHUT_WR), 0);
+  return nullptr;
+}
+
+static void* sendfile_receive_worker(void* context) {
+  sendfile_context_t* sendfile_context = (sendfile_context_t*)context;
+  std::vector<char> buf(sendfile_context->len);
+  ssize_t nbytes = recv_await(sendfile_context->sockfd, buf.data(),
+                              buf.size(), MSG_WAITALL);
+  EXPECT_EQ(nbytes, sendfile_context->len - 1);
+  std::vector<char> expected(sendfile_context->len);
+  for (size_t i = 0; i < expected.size(); i++) {
+    expected[i] = (char)(i + 1);
+  }
+  if (nbytes > 0) {
+    EXPECT_EQ(memcmp(buf.data(), expected.data(), nbytes), 0);
+  }
+  return nullptr;
+}
+
+/* Test case to verify a file larger than the pipe is sent in full through
+ * sendfile_await.
+ */
+TEST(SocketIO, SendFile) {
+  char filename[] = "/tmp/rocket_sendfileXXXXXX";
+  int fd = mkstemp(filename);
+  ASSERT_GE(fd, 0);
+  unlink(filename);
+  const size_t len = 3 * 1024 * 1024 + 123;
+  std::vector<char> content(len);
+  for (size_t i = 0; i < len; i++) {
+    content[i] = (char)i;
+  }
+  ASSERT_EQ(write(fd, content.data(), len), len);
+
+  int fds[2];
+  tcp_socket_pair(fds);
+
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  sendfile_context_t send_context = {fds[0], fd, len};
+  sendfile_context_t receive_context = {fds[1], -1, len};
+  rocket_executor_submit_task(executor, sendfile_receive_worker,
+                              &receive_context);
+  rocket_executor_submit_task(executor, sendfile_worker, &send_context);
+  rocket_executor_execute(executor);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+  close(fds[0]);
+  close(fds[1]);
+  close(fd);
+}
+
+static void* recv_timeout_worker(void* context) {
+  int sockfd = (intptr_t)context;
+  char buf[sizeof(message)];
+  rocket_fiber_set_io_timeout(/*timeout_ns=*/50 * 1000 * 1000);
+  // Nothing is ever sent.
+  EXPECT_EQ(recv_await(sockfd, buf, sizeof(buf), 0), -ETIME);
+
+  // Requests completing in time are not affected.
+  EXPECT_EQ(send_await(sockfd, message, sizeof(message), 0), sizeof(message));
+  rocket_fiber_set_io_timeout(0);
+  return nullptr;
+}
+
+// Test case to verify requests fail once the I/O timeout of the fiber expires.
+TEST(SocketIO, IoTimeout) {
+  int fds[2];
+  tcp_socket_pair(fds);
+
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  rocket_executor_submit_task(
+    executor, recv_timeout_worker, (void*)(intptr_t)fds[0]);
+  rocket_executor_execute(executor);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+static void* recv_late_canceled_worker(void* context) {
+  int sockfd = (intptr_t)context;
+  char buf[sizeof(message)];
+  rocket_fiber_set_io_timeout(/*timeout_ns=*/1000 * 1000);
+  // Canceled past its deadline, but before its timeout fired.
+  EXPECT_EQ(recv_await(sockfd, buf, sizeof(buf), 0), -ECANCELED);
+  rocket_fiber_set_io_timeout(0);
+  return nullptr;
+}
+
+static void* late_cancel_fd_worker(void* context) {
+  int sockfd = (intptr_t)context;
+  // The receive is only queued. Its deadline passes before the executor
+  // submits it, along with the cancellation.
+  usleep(5 * 1000);
+  EXPECT_EQ(cancel_fd_await(sockfd), 1);
+  return nullptr;
+}
+
+/* Test case to verify that only the timeout of a request makes it fail with
+ * -ETIME, and not another cancellation once its deadline passed.
+ */
+TEST(SocketIO, IoTimeoutCanceled) {
+  int fds[2];
+  tcp_socket_pair(fds);
+
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  rocket_executor_submit_task(
+    executor, recv_late_canceled_worker, (void*)(intptr_t)fds[0]);
+  rocket_executor_submit_task(
+    executor, late_cancel_fd_worker, (void*)(intptr_t)fds[0]);
+  rocket_executor_execute(executor);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+static void* recv_canceled_worker(void* context) {
+  int sockfd = (intptr_t)context;
+  char buf[sizeof(message)];
+  // Nothing is ever sent.
+  EXPECT_EQ(recv_await(sockfd, buf, sizeof(buf), 0), -ECANCELED);
+  return nullptr;
+}
+
+static void* cancel_fiber_worker(void* context) {
+  // The receiver ran first and is blocked by now.
+  rocket_fiber_cancel((rocket_fiber_t*)context);
+  return nullptr;
+}
+
+// Test case to verify canceling a fiber fails the request it's blocked on.
+TEST(SocketIO, CancelFiber) {
+  int fds[2];
+  tcp_socket_pair(fds);
+
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  rocket_fiber_t* receiver = rocket_executor_submit_task(
+    executor, recv_canceled_worker, (void*)(intptr_t)fds[0]);
+  ASSERT_NE(receiver, nullptr);
+  rocket_executor_submit_task(executor, cancel_fiber_worker, receiver);
+  rocket_executor_execute(executor);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+static void* cancel_fd_worker(void* context) {
+  int sockfd = (intptr_t)context;
+  // Both receivers are blocked by now.
+  EXPECT_EQ(cancel_fd_await(sockfd), 2);
+  return nullptr;
+}
+
+// Test case to verify all requests on a file descriptor can be canceled.
+TEST(SocketIO, CancelFd) {
+  int fds[2];
+  tcp_socket_pair(fds);
+
+  rocket_engine_t* engine = rocket_engine_create(queue_depth);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  rocket_executor_submit_task(
+    executor, recv_canceled_worker, (void*)(intptr_t)fds[0]);
+  rocket_executor_submit_task(
+    executor, recv_canceled_worker, (void*)(intptr_t)fds[0]);
+  rocket_executor_submit_task(
+    executor, cancel_fd_worker, (void*)(intptr_t)fds[0]);
+  rocket_executor_execute(executor);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+static void* cancel_idle_fd_worker(void* context) {
+  int sockfd = (intptr_t)context;
+  EXPECT_EQ(cancel_fd_await(sockfd), 0);
+  return nullptr;
+}
+
+// Test case to verify that canceling a file descriptor without requests
+// cancels none, on both backends.
+TEST(SocketIO, CancelIdleFd) {
+  rocket_engine_backend_t backends[] = {
+    ROCKET_ENGINE_IO_URING, ROCKET_ENGINE_EPOLL};
+  for (rocket_engine_backend_t backend : backends) {
+    int fds[2];
+    tcp_socket_pair(fds);
+    rocket_engine_config_t config;
+    rocket_engine_config_init(&config, queue_depth);
+    config.backend = backend;
+    rocket_engine_t* engine = rocket_engine_create_ex(&config);
+    ASSERT_NE(engine, nullptr);
+    rocket_executor_t* executor = rocket_executor_create(engine);
+    ASSERT_NE(executor, nullptr);
+
+    rocket_executor_submit_task(
+      executor, cancel_idle_fd_worker, (void*)(intptr_t)fds[0]);
+    rocket_executor_execute(executor);
+
+    rocket_executor_destroy(executor);
+    rocket_engine_destroy(engine);
+    close(fds[0]);
+    close(fds[1]);
+  }
+}
+
+static void* ping_worker(void* context) {
+  int sockfd = (intptr_t)context;
+  char buf[sizeof(message)];
+  for (size_t i = 0; i < message_count; i++) {
+    EXPECT_EQ(send_await(sockfd, message, sizeof(message), 0),
+              sizeof(message));
+    EXPECT_EQ(recv_await(sockfd, buf, sizeof(buf), MSG_WAITALL),
+              sizeof(buf));
+    EXPECT_EQ(memcmp(buf, message, sizeof(message)), 0);
+  }
+  return nullptr;
+}
+
+static void* pong_worker(void* context) {
+  int sockfd = (intptr_t)context;
+  char buf[sizeof(message)];
+  for (size_t i = 0; i < message_count; i++) {
+    EXPECT_EQ(recv_await(sockfd, buf, sizeof(buf), MSG_WAITALL),
+              sizeof(buf));
+    EXPECT_EQ(send_await(sockfd, buf, sizeof(buf), 0), sizeof(buf));
+  }
+  return nullptr;
+}
+
+/* Test case to verify that requests tried inline first behave the same
+ * whether they complete right away or go through the ring, and that some do
+ * complete right away.
+ */
+TEST(SocketIO, FastPath) {
+  int fds[2];
+  tcp_socket_pair(fds);
+
+  rocket_engine_config_t config;
+  rocket_engine_config_init(&config, queue_depth);
+  config.flags = ROCKET_ENGINE_FAST_PATH;
+  rocket_engine_t* engine = rocket_engine_create_ex(&config);
+  ASSERT_NE(engine, nullptr);
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+
+  rocket_executor_submit_task(
+    executor, ping_worker, (void*)(intptr_t)fds[0]);
+  rocket_executor_submit_task(
+    executor, pong_worker, (void*)(intptr_t)fds[1]);
+  rocket_executor_execute(executor);
+
+  // Sends go out inline at least, since the socket buffers never fill up.
+  rocket_engine_stats_t stats;
+  rocket_engine_get_stats(engine, &stats);
+  EXPECT_GE(stats.fast_path_syscalls, message_count * 2);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// Whether the running kernel is at least version major.minor.
+static bool kernel_at_least(int major, int minor) {
+  struct utsname name;
+  int running_major, running_minor;
+  if (uname(&name) < 0 ||
+      sscanf(name.release, "%d.%d", &running_major, &running_minor) != 2) {
+    return false;
+  }
+  return running_major > major ||
+         (running_major == major && running_minor >= minor);
+}
+
+/* Test case to verify that NAPI busy polling is registered on kernels
+ * supporting it and dropped on others, and that sockets keep working with it.
+ */
+TEST(SocketIO, NapiBusyPoll) {
+  int fds[2];
+  tcp_socket_pair(fds);
+
+  rocket_engine_config_t config;
+  rocket_engine_config_init(&config, queue_depth);
+  config.napi_busy_poll_us = 50;
+  config.flags = ROCKET_ENGINE_NAPI_PREFER_BUSY_POLL;
+  rocket_engine_t* engine = rocket_engine_create_ex(&config);
+  ASSERT_NE(engine, nullptr);
+
+  // Registering fails on kernels without NAPI support for io_uring only.
+  rocket_engine_config_t actual;
+  rocket_engine_get_config(engine, &actual);
+  if (kernel_at_least(6, 9)) {
+    EXPECT_EQ(actual.napi_busy_poll_us, config.napi_busy_poll_us);
+    EXPECT_TRUE(actual.flags & ROCKET_ENGINE_NAPI_PREFER_BUSY_POLL);
+  } else {
+    EXPECT_EQ(actual.napi_busy_poll_us, 0);
+    EXPECT_FALSE(actual.flags & ROCKET_ENGINE_NAPI_PREFER_BUSY_POLL);
+  }
+
+  rocket_executor_t* executor = rocket_executor_create(engine);
+  ASSERT_NE(executor, nullptr);
+  rocket_executor_submit_task(
+    executor, ping_worker, (void*)(intptr_t)fds[0]);
+  rocket_executor_submit_task(
+    executor, pong_worker, (void*)(intptr_t)fds[1]);
+  rocket_executor_execute(executor);
+
+  rocket_executor_destroy(executor);
+  rocket_engine_destroy(engine);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+// Loopback address the server of the connect test listens on. The port is 0
+// until it listens.
+static struct sockaddr_in server_addr;
+
+static void* connect_server_worker(void* context) {
+  int listenfd = socket_await(AF_INET, SOCK_STREAM, 0);
+  EXPECT_GE(listenfd, 0);
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addrlen = sizeof(addr);
+  EXPECT_EQ(bind_await(listenfd, (struct sockaddr*)&addr, addrlen), 0);
+  EXPECT_EQ(listen_await(listenfd, 1), 0);
+  EXPECT_EQ(getsockname(listenfd, (struct sockaddr*)&addr, &addrlen), 0);
+  server_addr = addr;
+
+  int fd = accept_await(listenfd, nullptr, nullptr, 0);
+  EXPECT_GE(fd, 0);
+  // Only the epoll backend makes the sockets non-blocking, for good.
+  EXPECT_EQ((fcntl(listenfd, F_GETFL) & O_NONBLOCK) != 0,
+            (intptr_t)context == ROCKET_ENGINE_EPOLL);
+  char buf[sizeof(message)];
+  EXPECT_EQ(recv_await(fd, buf, sizeof(buf), MSG_WAITALL), sizeof(buf));
+  EXPECT_EQ(send_await(fd, buf, sizeof(buf), 0), sizeof(buf));
+  // The client shut down its side.
+  EXPECT_EQ(recv_await(fd, buf, sizeof(buf), 0), 0);
+  EXPECT_EQ(close_await(fd), 0);
+  EXPECT_EQ(close_await(listenfd), 0);
+  return nullptr;
+}
+
+static void* connect_client_worker(void* context) {
+  // Yielding alone would keep the executor from reaping the requests of the
+  // server.
+  while (server_addr.sin_port == 0) {
+    EXPECT_EQ(rocket_sleep_await(1000 * 1000), 0);
+  }
+  int fd = socket_await(AF_INET, SOCK_STREAM, 0);
+  EXPECT_GE(fd, 0);
+  EXPECT_EQ(connect_await(fd, (struct sockaddr*)&server_addr,
+                          sizeof(server_addr)), 0);
+  EXPECT_EQ((fcntl(fd, F_GETFL) & O_NONBLOCK) != 0,
+            (intptr_t)context == ROCKET_ENGINE_EPOLL);
+  EXPECT_EQ(send_await(fd, message, sizeof(message), 0), sizeof(message));
+  char buf[sizeof(message)];
+  EXPECT_EQ(recv_await(fd, buf, sizeof(buf), MSG_WAITALL), sizeof(buf));
+  EXPECT_EQ(memcmp(buf, message, sizeof(message)), 0);
+  EXPECT_EQ(shutdown_await(fd, SHUT_WR), 0);
+  EXPECT_EQ(close_await(fd), 0);
+  return nullptr;
+}
+
+/* Test case to verify that fibers open, connect and shut down connections
+ * without blocking each other, on both backends.
+ */
+TEST(SocketIO, Connect) {
+  rocket_engine_backend_t backends[] = {
+    ROCKET_ENGINE_IO_URING, ROCKET_ENGINE_EPOLL};
+  for (rocket_engine_backend_t backend : backends) {
+    rocket_engine_config_t config;
+    rocket_engine_config_init(&config, queue_depth);
+    config.backend = backend;
+    rocket_engine_t* engine = rocket_engine_create_ex(&config);
+    ASSERT_NE(engine, nullptr);
+    rocket_executor_t* executor = rocket_executor_create(engine);
+    ASSERT_NE(executor, nullptr);
+
+    memset(&server_addr, 0, sizeof(server_addr));
+    rocket_executor_submit_task(executor, connect_server_worker,
+                                (void*)(intptr_t)backend);
+    rocket_executor_submit_task(executor, connect_client_worker,
+                                (void*)(intptr_t)backend);
+    rocket_executor_execute(executor);
+
+    rocket_executor_destroy(executor);
+    rocket_engine_destroy(engine);
+  }
+}